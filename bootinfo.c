@@ -38,10 +38,16 @@
 #include <ctype.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
 #include <sys/stat.h>
 #include <sys/file.h>
+#include <sys/socket.h>
+#include <linux/if_alg.h>
 #include <zlib.h>
+#include <keyutils.h>
 #include "bootinfo.h"
+#include "bootinfo-stores.h"
 #include "util.h"
 
 static const char DEVICE_MAGIC[8] = {'B', 'O', 'O', 'T', 'I', 'N', 'F', 'O'};
@@ -63,6 +69,16 @@ static const uint16_t DEVINFO_VERSION_CURRENT = 4;
 #define BOOTINFO_STORAGE_DEVICE "/dev/mmcblk0boot1"
 #endif
 
+#ifndef LOCKDIR
+#define LOCKDIR "/run/imx-bootinfo"
+#endif
+
+#ifndef ALG_SET_KEY_BY_KEY_SERIAL
+#define ALG_SET_KEY_BY_KEY_SERIAL 7
+#endif
+#define HMAC_ALG  "hmac(sha256)"
+#define HMAC_SIZE 32
+
 /*
  * Reserve a full sector for the header.  Variable data
  * will be packed in after the header, then spill over
@@ -82,14 +98,15 @@ struct device_info {
 	uint16_t ext_sectors;
 } __attribute__((packed));
 #define FLAG_BOOT_IN_PROGRESS	(1<<0)
+#define FLAG_AUTHENTICATED	(1<<1)
 #define DEVINFO_HDR_SIZE sizeof(struct device_info)
-#define VARSPACE_SIZE (DEVINFO_BLOCK_SIZE+EXTENSION_SIZE-(DEVINFO_HDR_SIZE+sizeof(uint32_t)))
 /*
- * Maximum size for a variable value is all of the variable space minus two bytes
- * for null terminators (for name and value) and one byte for a name, plus one
- * byte for the null character terminating the variable list.
+ * Size of a store with a given number of extension sectors.
+ * The end of the last extension sector holds the CRC, preceded
+ * by the HMAC for authenticated stores; the variable space is
+ * whatever remains after the header.
  */
-#define MAX_VALUE_SIZE (VARSPACE_SIZE-4)
+#define STORE_SIZE(sectors_) (DEVINFO_BLOCK_SIZE+(sectors_)*512)
 
 #ifndef BOOTINFO_STORAGE_OFFSET_A
 #define BOOTINFO_STORAGE_OFFSET_A  0
@@ -104,69 +121,425 @@ struct device_info {
 #define BOOTINFO_STORAGE_OFFSET_B (BOOTINFO_STORAGE_OFFSET_A + DEVINFO_BLOCK_SIZE + EXTENSION_SIZE)
 #endif
 
+#define OFFSET_COUNT 2
+
+/*
+ * Variable stores.  The default store is always present;
+ * additional named stores, each with its own device range
+ * and its own lock, are configured at build time through
+ * the EXTRA_STORES CMake setting.  The second copy of a
+ * named store directly follows the first.
+ *
+ * A store with an HMAC key (the description of a key in the
+ * user keyring) is authenticated: each copy carries an HMAC
+ * over the header and variable space, and copies without a
+ * valid HMAC are ignored.
+ */
+struct bootinfo_store {
+	const char *name;
+	const char *device;
+	off_t offset[OFFSET_COUNT];
+	unsigned int ext_sectors;
+	const char *hmac_key;
+};
+
+#define BOOTINFO_STORE(name_, dev_, offset_, sectors_, hmac_key_) \
+	{ #name_, dev_, { (offset_), (offset_) + STORE_SIZE(sectors_) }, (sectors_), hmac_key_ },
+static const struct bootinfo_store bootinfo_stores[] = {
+	{ BOOTINFO_DEFAULT_STORE, BOOTINFO_STORAGE_DEVICE,
+	  { BOOTINFO_STORAGE_OFFSET_A, BOOTINFO_STORAGE_OFFSET_B }, EXTENSION_SECTOR_COUNT,
+	  BOOTINFO_DEFAULT_HMAC_KEY },
+	BOOTINFO_EXTRA_STORES
+};
+#undef BOOTINFO_STORE
+
 struct info_var {
 	struct info_var *next;
 	char *name;
 	char *value;
 };
 
+/*
+ * Snapshots are immutable copies of the committed
+ * variables, shared by reference count.  The variables
+ * are kept in storage order, with a second array of
+ * the same entries sorted by name for lookups.
+ */
+struct snapshot_var {
+	const char *name;
+	const char *value;
+};
+
+struct bootinfo_snapshot {
+	atomic_uint refcount;
+	unsigned int count;
+	struct snapshot_var *byname;
+	struct snapshot_var vars[];
+};
+
 
 struct devinfo_context {
 	int fd;
 	int lockfd;
+	int wrlockfd;
+	int forcerofd;
+	int hmacfd;
 	bool readonly;
+	bool unauthenticated;
+	bool adopted;
 	int valid[2];
 	int current;
+	const struct bootinfo_store *store;
+	size_t infosize;
+	size_t trailersize;
+	size_t varspace;
 	struct device_info curinfo;
 	struct info_var *vars;
 	size_t varsize;
-	uint8_t infobuf[2][DEVINFO_BLOCK_SIZE+EXTENSION_SIZE];
-	char devinfo_dev[PATH_MAX];
-	/* storage for setting variables */
-	char namebuf[DEVINFO_BLOCK_SIZE];
-	char valuebuf[MAX_VALUE_SIZE];
+	uint8_t *infobuf[2];
+	size_t varused[2];
+	struct bootinfo_copy_status copystat[2];
+	/*
+	 * lock serializes operations on the context;
+	 * snaplock only guards the snapshot pointer, so
+	 * readers are not held up by a commit in progress.
+	 */
+	pthread_mutex_t lock;
+	pthread_mutex_t snaplock;
+	struct bootinfo_snapshot *snapshot;
 };
 
-#define OFFSET_COUNT 2
-static const off_t devinfo_offset[OFFSET_COUNT] = {
-	[0] = BOOTINFO_STORAGE_OFFSET_A,
-	[1] = BOOTINFO_STORAGE_OFFSET_B,
-};
+#define STORE_COUNT (sizeof(bootinfo_stores)/sizeof(bootinfo_stores[0]))
 
-static const off_t extension_offset[OFFSET_COUNT] = {
-	[0] = (BOOTINFO_STORAGE_OFFSET_A + DEVINFO_BLOCK_SIZE),
-	[1] = (BOOTINFO_STORAGE_OFFSET_B + DEVINFO_BLOCK_SIZE),
+/*
+ * Lock files are kept open for the life of the process,
+ * to save reopening them on every open of a store.  A
+ * lock file's fd is parked here, unlocked, only while no
+ * context is using it, so contexts in the same process
+ * still exclude each other.
+ */
+static struct {
+	pthread_mutex_t lock;
+	bool initialized;
+	int dirfd;
+	int lockfd[STORE_COUNT];
+	int wrlockfd[STORE_COUNT];
+} fdcache = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
 };
 
-static const char *devinfo_devices[] = {
-	[0] = BOOTINFO_STORAGE_DEVICE,
-};
+/*
+ * find_store
+ *
+ * Looks up a store by name (NULL selects the default
+ * store).  The device is checked for when it is opened.
+ *
+ * returns pointer to the store on success, NULL on failure.
+ */
+static const struct bootinfo_store *
+find_store (const char *name)
+{
+	unsigned int i;
+
+	if (name == NULL)
+		name = BOOTINFO_DEFAULT_STORE;
+	for (i = 0; i < STORE_COUNT; i++)
+		if (strcmp(name, bootinfo_stores[i].name) == 0)
+			return &bootinfo_stores[i];
+	errno = ENOENT;
+	return NULL;
+
+} /* find_store */
+
+/*
+ * get_lockfile
+ *
+ * Takes a lock file's fd from the cache, or opens (creating,
+ * if needed) the lock file in the run-time lock directory.
+ * The directory is opened once per process.
+ *
+ * returns fd on success, negative value on failure.
+ */
+static int
+get_lockfile (int *slot, const char *lockname)
+{
+	int fd;
+
+	pthread_mutex_lock(&fdcache.lock);
+	if (!fdcache.initialized) {
+		unsigned int i;
+		for (i = 0; i < STORE_COUNT; i++)
+			fdcache.lockfd[i] = fdcache.wrlockfd[i] = -1;
+		fdcache.dirfd = -1;
+		fdcache.initialized = true;
+	}
+	fd = slot[0];
+	if (fd >= 0) {
+		slot[0] = -1;
+		pthread_mutex_unlock(&fdcache.lock);
+		return fd;
+	}
+	if (fdcache.dirfd < 0) {
+		fdcache.dirfd = open(LOCKDIR, O_PATH|O_DIRECTORY|O_CLOEXEC);
+		if (fdcache.dirfd < 0 && errno == ENOENT) {
+			if (mkdir(LOCKDIR, 02770) == 0 || errno == EEXIST)
+				fdcache.dirfd = open(LOCKDIR, O_PATH|O_DIRECTORY|O_CLOEXEC);
+		}
+	}
+	fd = (fdcache.dirfd < 0 ? -1 : openat(fdcache.dirfd, lockname, O_CREAT|O_RDWR|O_CLOEXEC, 0770));
+	pthread_mutex_unlock(&fdcache.lock);
+	return fd;
+
+} /* get_lockfile */
+
+/*
+ * put_lockfile
+ *
+ * Unlocks a lock file and parks its fd in the
+ * cache, closing it if the slot is already taken.
+ */
+static void
+put_lockfile (int *slot, int fd)
+{
+	if (fd < 0)
+		return;
+	if (flock(fd, LOCK_UN) < 0) {
+		close(fd);
+		return;
+	}
+	pthread_mutex_lock(&fdcache.lock);
+	if (slot[0] < 0) {
+		slot[0] = fd;
+		fd = -1;
+	}
+	pthread_mutex_unlock(&fdcache.lock);
+	if (fd >= 0)
+		close(fd);
+
+} /* put_lockfile */
+
+/*
+ * bootdev_write_begin
+ *
+ * Makes the store's device writeable.  Since several stores
+ * can share a device, each writer holds a shared lock on a
+ * per-device lock file while it has the device open, and the
+ * read-only switch is only turned back on by the last writer
+ * to finish (see bootdev_write_end).  Only eMMC boot partitions
+ * have a switch; for other devices, sysfs is left alone.
+ */
+static int
+bootdev_write_begin (struct devinfo_context *ctx)
+{
+	char lockname[64];
+	const char *devname = strrchr(ctx->store->device, '/');
+	unsigned int idx = ctx->store - bootinfo_stores;
+
+	devname = (devname == NULL ? ctx->store->device : devname + 1);
+	snprintf(lockname, sizeof(lockname), "wrlock-%s", devname);
+	ctx->wrlockfd = get_lockfile(&fdcache.wrlockfd[idx], lockname);
+	if (ctx->wrlockfd < 0)
+		return -1;
+	if (flock(ctx->wrlockfd, LOCK_SH) < 0) {
+		close(ctx->wrlockfd);
+		ctx->wrlockfd = -1;
+		return -1;
+	}
+	ctx->forcerofd = bootdev_force_ro_open(ctx->store->device);
+	set_bootdev_writeable_status(ctx->forcerofd, true);
+	return 0;
+
+} /* bootdev_write_begin */
+
+/*
+ * bootdev_write_end
+ *
+ * Restores the device's read-only switch, unless another
+ * writer still has the device open.
+ */
+static void
+bootdev_write_end (struct devinfo_context *ctx)
+{
+	if (ctx->wrlockfd < 0)
+		return;
+	if (ctx->forcerofd >= 0) {
+		if (flock(ctx->wrlockfd, LOCK_EX|LOCK_NB) == 0)
+			set_bootdev_writeable_status(ctx->forcerofd, false);
+		close(ctx->forcerofd);
+		ctx->forcerofd = -1;
+	}
+	put_lockfile(&fdcache.wrlockfd[ctx->store - bootinfo_stores], ctx->wrlockfd);
+	ctx->wrlockfd = -1;
+
+} /* bootdev_write_end */
+
+/*
+ * alloc_context
+ *
+ * Allocates a context, with the buffers for both
+ * copies of the store sized to match the store.
+ */
+static struct devinfo_context *
+alloc_context (const struct bootinfo_store *store, bool readonly)
+{
+	struct devinfo_context *ctx;
+	size_t infosize = STORE_SIZE(store->ext_sectors);
+
+	ctx = calloc(1, sizeof(struct devinfo_context) + OFFSET_COUNT * infosize);
+	if (ctx == NULL)
+		return NULL;
+	ctx->fd = ctx->lockfd = ctx->wrlockfd = ctx->forcerofd = ctx->hmacfd = -1;
+	ctx->readonly = readonly;
+	ctx->store = store;
+	ctx->infosize = infosize;
+	ctx->trailersize = sizeof(uint32_t) + (store->hmac_key == NULL ? 0 : HMAC_SIZE);
+	ctx->varspace = infosize - (DEVINFO_HDR_SIZE + ctx->trailersize);
+	ctx->infobuf[0] = (uint8_t *)(ctx + 1);
+	ctx->infobuf[1] = ctx->infobuf[0] + infosize;
+	ctx->current = -1;
+	pthread_mutex_init(&ctx->lock, NULL);
+	pthread_mutex_init(&ctx->snaplock, NULL);
+	return ctx;
+
+} /* alloc_context */
 
 /*
- * find_storage_dev
+ * hmac_open
  *
- * Identifies the devinfo storage device
- * by iterating through devinfo_devices[]. First
- * successful access(F_OK) wins.
+ * Sets up an AF_ALG hash socket for computing HMACs with
+ * the store's key, which is looked up by description in the
+ * user keyring.  The key is handed to the kernel by serial
+ * number where supported (Linux 6.2 and later), so its payload
+ * never has to be read into user space.  On older kernels, only
+ * a "user" or "logon" key can be used, with its payload read and
+ * set directly: reading an "encrypted" or "trusted" key returns
+ * its wrapped blob, not the key, and that blob is kept in the
+ * clear in the default store.  The kernel's
+ * hmac(sha256) with the highest priority is used, which is
+ * the CAAM implementation when that is available.
  *
- * returns 0 on success, non-0 on failure.
+ * returns fd of the operation socket on success,
+ * negative value on failure.
  */
 static int
-find_storage_dev (char *buf, size_t bufsize)
+hmac_open (const char *keydesc)
 {
+	static const char *keytypes[] = { "encrypted", "trusted", "user", "logon" };
+	struct sockaddr_alg sa = {
+		.salg_family = AF_ALG,
+		.salg_type = "hash",
+		.salg_name = HMAC_ALG,
+	};
+	key_serial_t key = -1;
 	unsigned int i;
+	int tfmfd, opfd;
 
-	for (i = 0; i < sizeof(devinfo_devices)/sizeof(devinfo_devices[0]); i++) {
-		if (access(devinfo_devices[i], F_OK) == 0) {
-		        strncpy(buf, devinfo_devices[i], bufsize-1);
-			buf[bufsize-1] = '\0';
-			return 0;
+	for (i = 0; i < sizeof(keytypes)/sizeof(keytypes[0]); i++) {
+		key = keyctl_search(KEY_SPEC_USER_KEYRING, keytypes[i], keydesc, 0);
+		if (key >= 0)
+			break;
+	}
+	if (key < 0) {
+		errno = ENOKEY;
+		return -1;
+	}
+	tfmfd = socket(AF_ALG, SOCK_SEQPACKET|SOCK_CLOEXEC, 0);
+	if (tfmfd < 0)
+		return -1;
+	if (bind(tfmfd, (struct sockaddr *) &sa, sizeof(sa)) < 0) {
+		close(tfmfd);
+		return -1;
+	}
+	if (setsockopt(tfmfd, SOL_ALG, ALG_SET_KEY_BY_KEY_SERIAL, &key, sizeof(key)) < 0) {
+		void *keybuf;
+		long keylen;
+		int rc;
+		if (strcmp(keytypes[i], "user") != 0 && strcmp(keytypes[i], "logon") != 0) {
+			close(tfmfd);
+			errno = ENOKEY;
+			return -1;
+		}
+		keylen = keyctl_read_alloc(key, &keybuf);
+		if (keylen < 0) {
+			close(tfmfd);
+			return -1;
+		}
+		rc = setsockopt(tfmfd, SOL_ALG, ALG_SET_KEY, keybuf, keylen);
+		explicit_bzero(keybuf, keylen);
+		free(keybuf);
+		if (rc < 0) {
+			close(tfmfd);
+			return -1;
 		}
 	}
-	errno = ENODEV;
-	return -1;
+	opfd = accept4(tfmfd, NULL, NULL, SOCK_CLOEXEC);
+	close(tfmfd);
+	return opfd;
+
+} /* hmac_open */
+
+/*
+ * hmac_update
+ *
+ * Feeds data into the HMAC being computed.  Pass
+ * final as true for the last piece of the message.
+ */
+static int
+hmac_update (int hmacfd, const uint8_t *buf, size_t len, bool final)
+{
+	ssize_t cnt;
+
+	cnt = send(hmacfd, buf, len, (final ? 0 : MSG_MORE));
+	if (cnt < 0)
+		return -1;
+	if ((size_t) cnt != len) {
+		errno = EIO;
+		return -1;
+	}
+	return 0;
+
+} /* hmac_update */
+
+/*
+ * hmac_final
+ *
+ * Retrieves the HMAC once the full message has been sent.
+ */
+static int
+hmac_final (int hmacfd, uint8_t digest[HMAC_SIZE])
+{
+	if (read(hmacfd, digest, HMAC_SIZE) != HMAC_SIZE)
+		return -1;
+	return 0;
+
+} /* hmac_final */
+
+/*
+ * hmac_copy
+ *
+ * Computes the HMAC for one copy of the store, over the
+ * header block, the used part of the variable space and
+ * that part's length.  The rest of the variable space is
+ * zero by definition (anything else would change the used
+ * length), so it does not need to be hashed on every open.
+ */
+static int
+hmac_copy (struct devinfo_context *ctx, int idx, uint8_t digest[HMAC_SIZE])
+{
+	uint8_t *buf = ctx->infobuf[idx];
+	size_t usedend = DEVINFO_HDR_SIZE + ctx->varused[idx];
+	uint32_t usedlen = (uint32_t) ctx->varused[idx];
+
+	if (usedend < DEVINFO_BLOCK_SIZE)
+		usedend = DEVINFO_BLOCK_SIZE;
+	if (hmac_update(ctx->hmacfd, buf, DEVINFO_BLOCK_SIZE, false) < 0 ||
+	    hmac_update(ctx->hmacfd, buf + DEVINFO_BLOCK_SIZE,
+			usedend - DEVINFO_BLOCK_SIZE, false) < 0 ||
+	    hmac_update(ctx->hmacfd, (uint8_t *) &usedlen, sizeof(usedlen), true) < 0)
+		return -1;
+	return hmac_final(ctx->hmacfd, digest);
 
-} /* find_storage_dev */
+} /* hmac_copy */
 
 /*
  * parse_vars
@@ -194,7 +567,7 @@ parse_vars (struct devinfo_context *ctx)
 		return -1;
 	}
 	for (cp = (char *)(ctx->infobuf[ctx->current] + DEVINFO_HDR_SIZE),
-		     remain = sizeof(ctx->infobuf[ctx->current]) - (DEVINFO_HDR_SIZE+sizeof(uint32_t)),
+		     remain = ctx->varspace,
 		     ctx->varsize = 0,
 		     last = NULL;
 	     remain > 0 && *cp != '\0';
@@ -229,6 +602,34 @@ parse_vars (struct devinfo_context *ctx)
 
 } /* parse_vars */
 
+/*
+ * used_length
+ *
+ * Returns the length of a buffer without
+ * its trailing zero bytes.
+ */
+static size_t
+used_length (const uint8_t *buf, size_t len)
+{
+	uint64_t word;
+
+	while (len > 0 && (len % sizeof(word)) != 0) {
+		if (buf[len-1] != 0)
+			return len;
+		len -= 1;
+	}
+	while (len >= sizeof(word)) {
+		memcpy(&word, buf + len - sizeof(word), sizeof(word));
+		if (word != 0)
+			break;
+		len -= sizeof(word);
+	}
+	while (len > 0 && buf[len-1] == 0)
+		len -= 1;
+	return len;
+
+} /* used_length */
+
 /*
  * pack_vars
  *
@@ -238,15 +639,13 @@ static int
 pack_vars (struct devinfo_context *ctx, int idx)
 {
 	struct info_var *var;
-	char *cp;
-	size_t remain, nlen, vlen;
+	char *start, *cp;
+	size_t remain, nlen, vlen, used;
 
 	if (idx != 0 && idx != 1)
 		return -1;
-	if (ctx->vars == NULL)
-		return 0;
-	for (var = ctx->vars, cp = (char *)(ctx->infobuf[idx] + DEVINFO_HDR_SIZE),
-		     remain = sizeof(ctx->infobuf[ctx->current]) - (DEVINFO_HDR_SIZE+sizeof(uint32_t)+1);
+	start = (char *)(ctx->infobuf[idx] + DEVINFO_HDR_SIZE);
+	for (var = ctx->vars, cp = start, remain = ctx->varspace - 1;
 	     var != NULL && remain > 0;
 	     var = var->next) {
 		nlen = strlen(var->name) + 1;
@@ -265,6 +664,19 @@ pack_vars (struct devinfo_context *ctx, int idx)
 		return -1;
 	}
 	*cp = '\0';
+	/*
+	 * Clear out anything left over from a longer list
+	 * that was previously in this buffer, so that the
+	 * rest of the variable space is known to be zero.
+	 */
+	used = cp - start;
+	if (ctx->varused[idx] > used)
+		memset(cp, 0, ctx->varused[idx] - used);
+	/*
+	 * Record the used length the way check_copy finds it,
+	 * without trailing zeros, as the HMAC covers it.
+	 */
+	ctx->varused[idx] = used_length((uint8_t *) start, used);
 
 	return 0;
 
@@ -287,116 +699,461 @@ free_vars (struct info_var *firstvar)
 } /* free_vars */
 
 /*
- * find_bootinfo
+ * snapshot_compare
  *
- * Tries to find a valid bootinfo block, and initializes a context
- * if one is found.
+ * Orders snapshot entries by name.
+ */
+static int
+snapshot_compare (const void *a, const void *b)
+{
+	return strcmp(((const struct snapshot_var *) a)->name,
+		      ((const struct snapshot_var *) b)->name);
+
+} /* snapshot_compare */
+
+/*
+ * build_snapshot
  *
- * Returns negative value on an underlying error or if neither block
- * is valid.
+ * Creates a snapshot from a packed variable list.
+ * The snapshot is allocated as a single block, holding
+ * a copy of the variable data after the two arrays
+ * of entries.
+ */
+static struct bootinfo_snapshot *
+build_snapshot (const char *varbuf, size_t maxlen)
+{
+	struct bootinfo_snapshot *snap;
+	const char *cp;
+	char *data;
+	size_t remain, nlen, vlen, datalen;
+	unsigned int count, i;
+
+	for (cp = varbuf, remain = maxlen, count = 0; remain > 0 && *cp != '\0'; count++) {
+		nlen = strnlen(cp, remain) + 1;
+		if (nlen >= remain)
+			break;
+		vlen = strnlen(cp + nlen, remain - nlen) + 1;
+		if (nlen + vlen > remain)
+			break;
+		cp += nlen + vlen;
+		remain -= nlen + vlen;
+	}
+	datalen = cp - varbuf;
+
+	snap = malloc(sizeof(*snap) + 2 * count * sizeof(struct snapshot_var) + datalen);
+	if (snap == NULL)
+		return NULL;
+	atomic_init(&snap->refcount, 1);
+	snap->count = count;
+	snap->byname = &snap->vars[count];
+	data = (char *) &snap->byname[count];
+	memcpy(data, varbuf, datalen);
+	for (i = 0; i < count; i++) {
+		snap->vars[i].name = data;
+		data += strlen(data) + 1;
+		snap->vars[i].value = data;
+		data += strlen(data) + 1;
+	}
+	memcpy(snap->byname, snap->vars, count * sizeof(struct snapshot_var));
+	qsort(snap->byname, count, sizeof(struct snapshot_var), snapshot_compare);
+	return snap;
+
+} /* build_snapshot */
+
+/*
+ * publish_snapshot
  *
- * ctxp is set to NULL if an internal error occurred, otherwise it is
- * set to point to a valid context, and (*ctxp)->fd is the fd of
- * the open channel to the MMC boot1 device. Device is opened readonly
- * and (*ctxp)->readonly is set to true if the readonly arg is non-zero;
- * otherwise, (*ctxp)->readonly is set to true if a valid block is found
- * but an internal error occurred parsing the variables stored in the block.
+ * Replaces the context's snapshot with one built from
+ * the most recently committed copy of the store.  Must
+ * be called with the context lock held.  If the new
+ * snapshot can't be built, the context is left without
+ * one, to be retried on the next bootinfo_snapshot_get.
  */
-static int
-find_bootinfo (bool readonly, struct devinfo_context **ctxp, const char *devinfo_dev)
+static void
+publish_snapshot (struct devinfo_context *ctx)
 {
-	struct devinfo_context *ctx;
-	struct device_info *dp;
-	ssize_t n, cnt;
-	int i, dirfd;
+	struct bootinfo_snapshot *snap, *old;
 
-	*ctxp = NULL;
-	ctx = calloc(1, sizeof(struct devinfo_context));
-	if (ctx == NULL)
-		return -1;
-	ctx->readonly = readonly;
-	strcpy(ctx->devinfo_dev, devinfo_dev);
-
-	dirfd = open("/run/imx-bootinfo", O_PATH);
-	if (dirfd < 0) {
-		if (mkdir("/run/imx-bootinfo", 02770) < 0) {
-			close(ctx->fd);
-			if (!ctx->readonly)
-				set_bootdev_writeable_status(ctx->devinfo_dev, false);
-			free(ctx);
+	if (ctx->current < 0)
+		snap = build_snapshot("", 1);
+	else
+		snap = build_snapshot((char *) ctx->infobuf[ctx->current] + DEVINFO_HDR_SIZE,
+				      ctx->varspace);
+	pthread_mutex_lock(&ctx->snaplock);
+	old = ctx->snapshot;
+	ctx->snapshot = snap;
+	pthread_mutex_unlock(&ctx->snaplock);
+	bootinfo_snapshot_put(old);
+
+} /* publish_snapshot */
+
+/*
+ * pread_full / pwrite_full
+ *
+ * Positioned I/O, retried until the whole
+ * buffer has been transferred.
+ */
+static int
+pread_full (int fd, void *buf, size_t len, off_t offset)
+{
+	ssize_t cnt;
+	size_t n;
+
+	for (n = 0; n < len; n += cnt) {
+		cnt = pread(fd, (uint8_t *) buf + n, len - n, offset + n);
+		if (cnt <= 0) {
+			if (cnt == 0)
+				errno = EIO;
 			return -1;
 		}
-		dirfd = open("/run/imx-bootinfo", O_PATH);
 	}
-	ctx->lockfd = openat(dirfd, "lockfile", O_CREAT|O_RDWR, 0770);
-	if (ctx->lockfd < 0) {
-		close(dirfd);
-		free(ctx);
-		return -1;
+	return 0;
+
+} /* pread_full */
+
+static int
+pwrite_full (int fd, const void *buf, size_t len, off_t offset)
+{
+	ssize_t cnt;
+	size_t n;
+
+	for (n = 0; n < len; n += cnt) {
+		cnt = pwrite(fd, (const uint8_t *) buf + n, len - n, offset + n);
+		if (cnt < 0)
+			return -1;
 	}
-	close(dirfd);
-	if (flock(ctx->lockfd, (readonly ? LOCK_SH : LOCK_EX)) < 0) {
-		close(ctx->lockfd);
-		free(ctx);
+	return 0;
+
+} /* pwrite_full */
+
+#ifdef BOOTINFO_FAULT_INJECTION
+/*
+ * Fault injection, for testing recovery from interrupted
+ * writes.  With IMX_BOOTINFO_FAULT_SECTORS=N in the
+ * environment, the first N sectors written by the process
+ * reach the device, and all writes after that fail with
+ * EIO, as if power had been lost at that sector boundary.
+ */
+static struct {
+	pthread_mutex_t lock;
+	bool initialized;
+	long sectors_left;
+} fault = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/*
+ * fault_allowance
+ *
+ * returns how many bytes of a write of len bytes
+ * may reach the device before the injected fault.
+ */
+static size_t
+fault_allowance (size_t len)
+{
+	size_t allowed = len;
+
+	pthread_mutex_lock(&fault.lock);
+	if (!fault.initialized) {
+		const char *env = getenv("IMX_BOOTINFO_FAULT_SECTORS");
+		fault.sectors_left = (env == NULL ? -1 : strtol(env, NULL, 10));
+		fault.initialized = true;
+	}
+	if (fault.sectors_left >= 0) {
+		if ((size_t) fault.sectors_left * 512 < len)
+			allowed = fault.sectors_left * 512;
+		fault.sectors_left -= allowed / 512;
+	}
+	pthread_mutex_unlock(&fault.lock);
+	return allowed;
+
+} /* fault_allowance */
+#endif
+
+/*
+ * write_sectors
+ *
+ * Writes whole sectors of a copy of the store.
+ */
+static int
+write_sectors (struct devinfo_context *ctx, int idx, const void *buf, size_t len, off_t offset)
+{
+#ifdef BOOTINFO_FAULT_INJECTION
+	size_t allowed = fault_allowance(len);
+
+	if (allowed < len) {
+		if (allowed > 0)
+			pwrite_full(ctx->fd, buf, allowed, ctx->store->offset[idx] + offset);
+		errno = EIO;
 		return -1;
 	}
-	if (!ctx->readonly)
-		set_bootdev_writeable_status(ctx->devinfo_dev, true);
+#endif
+	return pwrite_full(ctx->fd, buf, len, ctx->store->offset[idx] + offset);
 
-	ctx->fd = open(devinfo_dev, (readonly ? O_RDONLY : O_RDWR|O_DSYNC));
-	if (ctx->fd < 0) {
-		if (!ctx->readonly)
-			set_bootdev_writeable_status(ctx->devinfo_dev, false);
-		close(ctx->lockfd);
-		free(ctx);
+} /* write_sectors */
+
+/*
+ * invalidate_copy
+ *
+ * Zeroes the header block of one copy of the store.
+ */
+static int
+invalidate_copy (struct devinfo_context *ctx, int idx)
+{
+	static const uint8_t zeroes[DEVINFO_BLOCK_SIZE];
+
+	ctx->valid[idx] = 0;
+	return write_sectors(ctx, idx, zeroes, sizeof(zeroes), 0);
+
+} /* invalidate_copy */
+
+/*
+ * write_copy
+ *
+ * Writes out one copy of the store from its buffer.
+ *
+ * The header block and the extension have separate CRCs,
+ * so if the write were interrupted between the two, the
+ * copy could pass both checks while holding a mix of old
+ * and new variables.  To rule that out, the header block
+ * is invalidated first and written last; an interrupted
+ * write always leaves the copy invalid, and the other
+ * copy is used.
+ */
+static int
+write_copy (struct devinfo_context *ctx, int idx)
+{
+	if (invalidate_copy(ctx, idx) < 0 ||
+	    write_sectors(ctx, idx, ctx->infobuf[idx] + DEVINFO_BLOCK_SIZE,
+			  ctx->infosize - DEVINFO_BLOCK_SIZE, DEVINFO_BLOCK_SIZE) < 0)
 		return -1;
+	return write_sectors(ctx, idx, ctx->infobuf[idx], DEVINFO_BLOCK_SIZE, 0);
+
+} /* write_copy */
+
+/*
+ * close_bootinfo
+ *
+ * Cleans up a context, freeing memory and closing open channels.
+ */
+static void
+close_bootinfo (struct devinfo_context *ctx)
+{
+	if (ctx == NULL)
+		return;
+	if (ctx->fd >= 0)
+		close(ctx->fd);
+	if (ctx->hmacfd >= 0)
+		close(ctx->hmacfd);
+	bootdev_write_end(ctx);
+	put_lockfile(&fdcache.lockfd[ctx->store - bootinfo_stores], ctx->lockfd);
+	free_vars(ctx->vars);
+	bootinfo_snapshot_put(ctx->snapshot);
+	pthread_mutex_destroy(&ctx->snaplock);
+	pthread_mutex_destroy(&ctx->lock);
+	free(ctx);
+
+} /* close_bootinfo */
+
+/*
+ * crc32_zeros
+ *
+ * Extends a CRC across a run of zero bytes in logarithmic
+ * time.  Feeding zeros through the CRC register is a linear
+ * operation, the same one that crc32_combine applies to
+ * its first argument; the complements account for zlib's
+ * pre- and post-conditioning of the register.
+ */
+static uint32_t
+crc32_zeros (uint32_t crc, size_t len)
+{
+	if (len == 0)
+		return crc;
+	return ~crc32_combine(~crc & 0xffffffffUL, 0, len) & 0xffffffffUL;
+
+} /* crc32_zeros */
+
+/*
+ * extension_crc
+ *
+ * Computes the CRC over a copy's extension (up to the CRC
+ * itself).  Variables rarely fill more than a small part of
+ * the store, and the variable space past varused is known
+ * to be zero, so the CRC is computed over the used part and
+ * the trailer, and carried across the zeros between them
+ * with crc32_zeros.  The result is the same as a full pass.
+ */
+static uint32_t
+extension_crc (struct devinfo_context *ctx, int idx)
+{
+	size_t zerostart = DEVINFO_HDR_SIZE + ctx->varused[idx];
+	size_t zeroend = ctx->infosize - ctx->trailersize;
+	uLong crc;
+
+	if (zerostart < DEVINFO_BLOCK_SIZE)
+		zerostart = DEVINFO_BLOCK_SIZE;
+	crc = crc32(0, &ctx->infobuf[idx][DEVINFO_BLOCK_SIZE], zerostart - DEVINFO_BLOCK_SIZE);
+	crc = crc32_zeros(crc, zeroend - zerostart);
+	return crc32(crc, &ctx->infobuf[idx][zeroend], ctx->trailersize - sizeof(uint32_t));
+
+} /* extension_crc */
+
+/*
+ * check_copy
+ *
+ * Validates one copy of the store after it has been read,
+ * recording the result of each check in the copy's status.
+ * For a store whose authentication key is unavailable (which
+ * can only happen when examining an image), the HMAC is left
+ * unchecked.
+ */
+static void
+check_copy (struct devinfo_context *ctx, int i, bool readok)
+{
+	struct bootinfo_copy_status *st = &ctx->copystat[i];
+	struct device_info *dp = (struct device_info *)(ctx->infobuf[i]);
+	size_t extsize = ctx->infosize - DEVINFO_BLOCK_SIZE;
+	uint32_t crcsum;
+
+	memset(st, 0, sizeof(*st));
+	st->offset = ctx->store->offset[i];
+	st->hmac_ok = -1;
+	ctx->valid[i] = 0;
+	if (!readok) {
+		/* contents unknown */
+		ctx->varused[i] = ctx->varspace;
+		return;
 	}
-	for (i = 0; i < OFFSET_COUNT; i++) {
-		/*
-		 * Read base block
-		 */
-		if (lseek(ctx->fd, devinfo_offset[i], SEEK_SET) < 0)
-			continue;
-		for (n = 0; n < DEVINFO_BLOCK_SIZE; n += cnt) {
-			cnt = read(ctx->fd, &ctx->infobuf[i][n], DEVINFO_BLOCK_SIZE-n);
-			if (cnt < 0)
-				break;
+	st->readable = 1;
+	ctx->varused[i] = used_length(ctx->infobuf[i] + DEVINFO_HDR_SIZE, ctx->varspace);
+	if (memcmp(dp->magic, DEVICE_MAGIC, DEVICE_MAGIC_SIZE) != 0)
+		return;
+	st->magic_ok = 1;
+	st->version = dp->devinfo_version;
+	st->flags = dp->flags;
+	st->failed_boots = dp->failed_boots;
+	st->sernum = dp->sernum;
+	st->ext_sectors = dp->ext_sectors;
+	/* unrecognized version, or different layout */
+	if (dp->devinfo_version < DEVINFO_VERSION_CURRENT ||
+	    dp->ext_sectors != ctx->store->ext_sectors)
+		return;
+	/*
+	 * Header block CRC is computed with the crcsum
+	 * field zeroed
+	 */
+	crcsum = dp->crcsum;
+	dp->crcsum = 0;
+	st->header_crc_ok = crc32(0, ctx->infobuf[i], DEVINFO_BLOCK_SIZE) == crcsum;
+	dp->crcsum = crcsum;
+	crcsum = *(uint32_t *)(&ctx->infobuf[i][DEVINFO_BLOCK_SIZE+extsize-sizeof(uint32_t)]);
+	st->ext_crc_ok = extension_crc(ctx, i) == crcsum;
+	if (!(st->header_crc_ok && st->ext_crc_ok))
+		return;
+	if (ctx->hmacfd >= 0) {
+		uint8_t digest[HMAC_SIZE];
+		uint8_t *macptr = &ctx->infobuf[i][ctx->infosize-ctx->trailersize];
+		uint8_t diff = 0;
+		unsigned int j;
+		if ((dp->flags & FLAG_AUTHENTICATED) == 0 ||
+		    hmac_copy(ctx, i, digest) < 0)
+			st->hmac_ok = 0;
+		else {
+			for (j = 0; j < HMAC_SIZE; j++)
+				diff |= digest[j] ^ macptr[j];
+			st->hmac_ok = (diff == 0);
 		}
-		if (n < DEVINFO_BLOCK_SIZE)
-			continue;
+		if (!st->hmac_ok)
+			return;
+	}
+	st->valid = 1;
+	ctx->valid[i] = 1;
+
+} /* check_copy */
 
-		dp = (struct device_info *)(ctx->infobuf[i]);
+/*
+ * read_copies
+ *
+ * Reads both copies of the store from the context's fd
+ * and checks them, filling in the per-copy status.
+ */
+static void
+read_copies (struct devinfo_context *ctx)
+{
+	const struct bootinfo_store *store = ctx->store;
+	bool readok[OFFSET_COUNT] = { false, false };
+	int i;
 
-		if (memcmp(dp->magic, DEVICE_MAGIC, DEVICE_MAGIC_SIZE) != 0)
+	/*
+	 * The copies are normally adjacent, and the buffers
+	 * for them are too, so both are read with a single
+	 * pread; otherwise, or if that fails, each copy is
+	 * read separately.
+	 */
+	if (store->offset[1] != store->offset[0] + (off_t) ctx->infosize ||
+	    pread_full(ctx->fd, ctx->infobuf[0], OFFSET_COUNT * ctx->infosize, store->offset[0]) < 0) {
+		for (i = 0; i < OFFSET_COUNT; i++)
+			readok[i] = pread_full(ctx->fd, ctx->infobuf[i], ctx->infosize, store->offset[i]) == 0;
+	} else
+		readok[0] = readok[1] = true;
+
+	for (i = 0; i < OFFSET_COUNT; i++)
+		check_copy(ctx, i, readok[i]);
+
+} /* read_copies */
+
+/*
+ * check_unauthenticated
+ *
+ * For an authenticated store with no valid copy, looks for
+ * copies that pass their CRC checks but carry no HMAC, as
+ * written before authentication was enabled for the store.
+ * Such a copy is only used if the caller asks to adopt it,
+ * and its variables fit in the space left by the HMAC, so
+ * that it can be rewritten with one.  Otherwise the context
+ * is marked, so that a read-write open does not initialize
+ * the store over it.
+ */
+static void
+check_unauthenticated (struct devinfo_context *ctx, bool adopt)
+{
+	int i;
+
+	if (ctx->hmacfd < 0 || ctx->valid[0] || ctx->valid[1])
+		return;
+	for (i = 0; i < OFFSET_COUNT; i++) {
+		struct bootinfo_copy_status *st = &ctx->copystat[i];
+		if (!(st->header_crc_ok && st->ext_crc_ok) ||
+		    (st->flags & FLAG_AUTHENTICATED) != 0)
 			continue;
-		if (dp->devinfo_version >= DEVINFO_VERSION_CURRENT) {
-			uint32_t crcsum;
-			if (dp->ext_sectors != EXTENSION_SECTOR_COUNT) {
-				continue;
-			}
-			/*
-			 * Read extension block
-			 */
-			if (lseek(ctx->fd, extension_offset[i], SEEK_SET) < 0)
-				continue;
-			for (n = 0; n < EXTENSION_SIZE; n += cnt) {
-				cnt = read(ctx->fd, &ctx->infobuf[i][DEVINFO_BLOCK_SIZE+n], EXTENSION_SIZE-n);
-				if (cnt < 0)
-					break;
-			}
-			if (n < EXTENSION_SIZE)
-				continue;
-			crcsum = *(uint32_t *)(&ctx->infobuf[i][DEVINFO_BLOCK_SIZE+EXTENSION_SIZE-sizeof(uint32_t)]);
-			if (crc32(0, &ctx->infobuf[i][DEVINFO_BLOCK_SIZE], EXTENSION_SIZE-sizeof(uint32_t)) != crcsum)
-				continue;
-		} else
-			continue; /* unrecognized version */
-		ctx->valid[i] = 1;
+		ctx->unauthenticated = true;
+		if (adopt &&
+		    used_length(ctx->infobuf[i] + DEVINFO_HDR_SIZE,
+				ctx->varspace + HMAC_SIZE) <= ctx->varspace) {
+			ctx->valid[i] = 1;
+			ctx->adopted = true;
+		}
 	}
-	*ctxp = ctx;
+
+} /* check_unauthenticated */
+
+/*
+ * select_current
+ *
+ * Picks the current copy from the valid ones, by serial
+ * number, and parses its variables.
+ *
+ * Returns negative value if neither copy is valid.
+ */
+static int
+select_current (struct devinfo_context *ctx)
+{
+	struct device_info *dp;
+
 	if (!(ctx->valid[0] || ctx->valid[1])) {
 		ctx->current = -1;
 		memset(&ctx->curinfo, 0, sizeof(ctx->curinfo));
+		errno = ENODATA;
 		return -1;
 	} else if (ctx->valid[0] && !ctx->valid[1])
 		ctx->current = 0;
@@ -415,34 +1172,107 @@ find_bootinfo (bool readonly, struct devinfo_context **ctxp, const char *devinfo
 		else
 			ctx->current = 0;
 	}
-	memcpy(&ctx->curinfo, ctx->infobuf[ctx->current], sizeof(ctx->curinfo));
-	if (parse_vars(ctx) < 0) {
-		/* internal error ? */
-		if (!ctx->readonly)
-			set_bootdev_writeable_status(ctx->devinfo_dev, false);
-		ctx->readonly = true;
+	ctx->copystat[ctx->current].current = 1;
+	memcpy(&ctx->curinfo, ctx->infobuf[ctx->current], sizeof(ctx->curinfo));
+	if (parse_vars(ctx) < 0) {
+		/* internal error ? */
+		bootdev_write_end(ctx);
+		ctx->readonly = true;
+	}
+	return 0;
+
+} /* select_current */
+
+/*
+ * find_bootinfo
+ *
+ * Tries to find a valid bootinfo block, and initializes a context
+ * if one is found.
+ *
+ * Returns negative value on an underlying error or if neither block
+ * is valid.
+ *
+ * ctxp is set to NULL if an internal error occurred, otherwise it is
+ * set to point to a valid context, and (*ctxp)->fd is the fd of
+ * the open channel to the store's device. Device is opened readonly
+ * and (*ctxp)->readonly is set to true if the readonly arg is non-zero;
+ * otherwise, (*ctxp)->readonly is set to true if a valid block is found
+ * but an internal error occurred parsing the variables stored in the block.
+ *
+ * The context is returned even if neither block is valid, so that
+ * a read-write open can initialize the store.  It still holds the
+ * store's lock, so the caller must close it on error.
+ *
+ * For an authenticated store, a block without an HMAC is used only
+ * if adopt is true (see check_unauthenticated); if one is found and
+ * not used, the error is EKEYREJECTED.
+ */
+static int
+find_bootinfo (bool readonly, struct devinfo_context **ctxp, const struct bootinfo_store *store,
+	       bool adopt)
+{
+	struct devinfo_context *ctx;
+	char lockname[64];
+
+	*ctxp = NULL;
+	ctx = alloc_context(store, readonly);
+	if (ctx == NULL)
+		return -1;
+	if (store->hmac_key != NULL) {
+		ctx->hmacfd = hmac_open(store->hmac_key);
+		if (ctx->hmacfd < 0) {
+			close_bootinfo(ctx);
+			return -1;
+		}
+	}
+
+	if (store == &bootinfo_stores[0])
+		strcpy(lockname, "lockfile");
+	else
+		snprintf(lockname, sizeof(lockname), "lockfile-%s", store->name);
+	ctx->lockfd = get_lockfile(&fdcache.lockfd[store - bootinfo_stores], lockname);
+	if (ctx->lockfd < 0 || flock(ctx->lockfd, (readonly ? LOCK_SH : LOCK_EX)) < 0) {
+		close_bootinfo(ctx);
+		return -1;
+	}
+	if (!ctx->readonly && bootdev_write_begin(ctx) < 0) {
+		close_bootinfo(ctx);
+		return -1;
+	}
+
+	ctx->fd = open(store->device, (readonly ? O_RDONLY : O_RDWR|O_DSYNC)|O_CLOEXEC);
+	if (ctx->fd < 0) {
+		if (errno == ENOENT)
+			errno = ENODEV;
+		close_bootinfo(ctx);
+		return -1;
+	}
+	read_copies(ctx);
+	check_unauthenticated(ctx, adopt);
+	*ctxp = ctx;
+	if (select_current(ctx) < 0) {
+		if (ctx->unauthenticated)
+			errno = EKEYREJECTED;
+		return -1;
 	}
 	return 0;
 
 } /* find_bootinfo */
 
 /*
- * bootinfo_update
+ * update_bootinfo
  *
- * Write out a device info block based on the current context.
+ * Write out a device info block based on the current context,
+ * and publish a new snapshot once it has been written.
+ * Must be called with the context lock held.
  */
-int
-bootinfo_update (struct devinfo_context *ctx)
+static int
+update_bootinfo (struct devinfo_context *ctx)
 {
 	uint32_t *crcptr;
 	struct device_info *info;
-	ssize_t n, cnt;
 	int idx;
 
-	if (ctx == NULL) {
-		errno = EINVAL;
-		return -1;
-	}
 	if (ctx->readonly) {
 		errno = EROFS;
 		return -1;
@@ -456,66 +1286,90 @@ bootinfo_update (struct devinfo_context *ctx)
 		idx = 1 - ctx->current;
 
 	info = (struct device_info *) ctx->infobuf[idx];
-	crcptr = (uint32_t *) &ctx->infobuf[idx][DEVINFO_BLOCK_SIZE + EXTENSION_SIZE - sizeof(uint32_t)];
+	crcptr = (uint32_t *) &ctx->infobuf[idx][ctx->infosize - sizeof(uint32_t)];
 	memset(info, 0, DEVINFO_BLOCK_SIZE);
 	memcpy(info->magic, DEVICE_MAGIC, sizeof(info->magic));
 	info->devinfo_version = DEVINFO_VERSION_CURRENT;
-	info->flags = ctx->curinfo.flags;
+	info->flags = ctx->curinfo.flags & ~FLAG_AUTHENTICATED;
+	if (ctx->hmacfd >= 0)
+		info->flags |= FLAG_AUTHENTICATED;
 	info->failed_boots = ctx->curinfo.failed_boots;
 	info->sernum = ctx->curinfo.sernum + 1;
-	info->ext_sectors = EXTENSION_SECTOR_COUNT;
+	info->ext_sectors = ctx->store->ext_sectors;
 	if (pack_vars(ctx, idx) < 0)
 		return -1;
 	info->crcsum = crc32(0, ctx->infobuf[idx], DEVINFO_BLOCK_SIZE);
-	*crcptr = crc32(0, &ctx->infobuf[idx][DEVINFO_BLOCK_SIZE], EXTENSION_SIZE-sizeof(uint32_t));
+	if (ctx->hmacfd >= 0 &&
+	    hmac_copy(ctx, idx, &ctx->infobuf[idx][ctx->infosize - ctx->trailersize]) < 0)
+		return -1;
+	*crcptr = extension_crc(ctx, idx);
 
-	if (lseek(ctx->fd, devinfo_offset[idx], SEEK_SET) < 0)
+	if (write_copy(ctx, idx) < 0)
 		return -1;
-	for (n = 0; n < DEVINFO_BLOCK_SIZE; n += cnt) {
-		cnt = write(ctx->fd, ctx->infobuf[idx] + n, DEVINFO_BLOCK_SIZE-n);
-		if (cnt < 0)
-			return -1;
+	/*
+	 * The copy just written becomes the current one, so the
+	 * next update goes to the other copy, and the variable
+	 * list is re-pointed into it, so the caller's strings
+	 * are no longer referenced once the update is done.
+	 */
+	ctx->valid[idx] = 1;
+	ctx->current = idx;
+	memcpy(&ctx->curinfo, info, sizeof(ctx->curinfo));
+	free_vars(ctx->vars);
+	if (parse_vars(ctx) < 0) {
+		bootdev_write_end(ctx);
+		ctx->readonly = true;
 	}
-	if (lseek(ctx->fd, extension_offset[idx], SEEK_SET) < 0)
+	publish_snapshot(ctx);
+	return 0;
+
+} /* update_bootinfo */
+
+/*
+ * bootinfo_update
+ *
+ * Public API for update_bootinfo.
+ */
+int
+bootinfo_update (struct devinfo_context *ctx)
+{
+	int ret;
+
+	if (ctx == NULL) {
+		errno = EINVAL;
 		return -1;
-	for (n = 0; n < EXTENSION_SIZE; n += cnt) {
-		cnt = write(ctx->fd, ctx->infobuf[idx] + DEVINFO_BLOCK_SIZE + n, EXTENSION_SIZE-n);
-		if (cnt < 0)
-			return -1;
 	}
-
-	return 0;
+	pthread_mutex_lock(&ctx->lock);
+	ret = update_bootinfo(ctx);
+	pthread_mutex_unlock(&ctx->lock);
+	return ret;
 
 } /* bootinfo_update */
 
 /*
- * close_bootinfo
+ * bootinfo_revert
  *
- * Cleans up a context, freeing memory and closing open channels.
+ * Discards any variable changes made with bootinfo_bootvar_set
+ * since the context was opened or last updated.
  */
-static int
-close_bootinfo (struct devinfo_context *ctx, bool keeplock)
+int
+bootinfo_revert (struct devinfo_context *ctx)
 {
-	int lockfd = -1;
+	int ret = 0;
 
-	if (ctx == NULL)
-		return lockfd;
-	if (!ctx->readonly)
-		set_bootdev_writeable_status(ctx->devinfo_dev, false);
-	if (ctx->fd >= 0)
-		close(ctx->fd);
-	if (keeplock)
-		lockfd = ctx->lockfd;
-	else if (ctx->lockfd >= 0)
-		close(ctx->lockfd);
-	ctx->fd = -1;
-	ctx->lockfd = -1;
+	if (ctx == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	pthread_mutex_lock(&ctx->lock);
 	free_vars(ctx->vars);
-	free(ctx);
-
-	return lockfd;
+	ctx->vars = NULL;
+	if (ctx->current >= 0)
+		ret = parse_vars(ctx);
+	pthread_mutex_unlock(&ctx->lock);
+	return ret;
 
-} /* close_bootinfo */
+} /* bootinfo_revert */
 
 /*
  * bootinfo_close
@@ -526,45 +1380,83 @@ void
 bootinfo_close (struct devinfo_context *ctx)
 {
 	if (ctx != NULL)
-		close_bootinfo(ctx, false);
+		close_bootinfo(ctx);
 
 } /* bootinfo_close */
 
 /*
- * bootinfo_open
+ * rewrite_store
  *
- * Open a context for using bootinfo
+ * Writes the context's state out as an ordinary update,
+ * into the copy that is not current, keeping the serial
+ * number sequence so that it supersedes the current copy.
+ * Only then is the other copy invalidated, so that an
+ * interruption at any point leaves either the old store
+ * or the new one.
+ */
+static int
+rewrite_store (struct devinfo_context *ctx)
+{
+	if (bootinfo_update(ctx) < 0)
+		return -1;
+	if (invalidate_copy(ctx, 1 - ctx->current) < 0) {
+		errno = EIO;
+		return -1;
+	}
+	return 0;
+
+} /* rewrite_store */
+
+/*
+ * bootinfo_open_store
+ *
+ * Open a context for using a bootinfo store.  Pass NULL
+ * as the store name to use the default store.
  * Flags:
  *    BOOTINFO_O_RDONLY      - open read-only, otherwise will be read-write
  *    BOOTINFO_O_FORCE_INIT  - init in-storage structures even if present
+ *    BOOTINFO_O_AUTHENTICATE - adopt a store written without an HMAC,
+ *                             rewriting it with one
+ *
+ * A read-write open of an authenticated store that only holds
+ * copies without an HMAC fails with EKEYREJECTED, rather than
+ * initializing the store over them, unless BOOTINFO_O_AUTHENTICATE
+ * is given.
  *
  * If ctxp is non-NULL, the initialized context is left open for
- * further bootinfo API calls.
+ * further bootinfo API calls.  On failure, *ctxp is set to NULL
+ * and the store is left unlocked.
  */
 int
-bootinfo_open (struct devinfo_context **ctxp, unsigned int flags)
+bootinfo_open_store (struct devinfo_context **ctxp, const char *storename,
+		     unsigned int flags)
 {
-	int i, fd = -1, lockfd = -1;
-	bool reset_bootdev = false;
-	ssize_t n, cnt;
+	uint8_t sernum;
+	const struct bootinfo_store *store;
 	struct devinfo_context *ctx = NULL;
-	uint8_t *buf = NULL;
-	struct info_var *var, *preserve_list = NULL;
-	char devinfo_dev[PATH_MAX];
+	struct info_var *var, *prev, *preserve_list = NULL;
 
 	if (ctxp == NULL || ((flags & BOOTINFO_O_RDONLY) != 0 &&
-			     (flags & BOOTINFO_O_FORCE_INIT) != 0)) {
+			     (flags & (BOOTINFO_O_FORCE_INIT|BOOTINFO_O_AUTHENTICATE)) != 0)) {
 		errno = EINVAL;
 		return -1;
 	}
+	*ctxp = NULL;
 
-	if (find_storage_dev(devinfo_dev, sizeof(devinfo_dev)) < 0) {
-		*ctxp = NULL;
+	store = find_store(storename);
+	if (store == NULL)
 		return -1;
-	}
 
-	if ((flags & BOOTINFO_O_RDONLY) != 0)
-		return find_bootinfo(true, ctxp, devinfo_dev);
+	if ((flags & BOOTINFO_O_RDONLY) != 0) {
+		if (find_bootinfo(true, &ctx, store, false) < 0) {
+			int err = errno;
+			close_bootinfo(ctx);
+			errno = err;
+			return -1;
+		}
+		*ctxp = ctx;
+		return 0;
+	}
 
 	/*
 	 * For read-write opens, we initialize the in-storage
@@ -572,116 +1464,110 @@ bootinfo_open (struct devinfo_context **ctxp, unsigned int flags)
 	 * does *not* return an error, we only initialize if
 	 * the FORCE_INIT flag is set.
 	 */
-	if (find_bootinfo(false, &ctx, devinfo_dev) == 0 &&
+	if (find_bootinfo(false, &ctx, store, (flags & BOOTINFO_O_AUTHENTICATE) != 0) == 0 &&
 	    ctx != NULL &&
 	    (flags & BOOTINFO_O_FORCE_INIT) == 0) {
+		/*
+		 * An adopted copy is rewritten right away, so
+		 * that the store is authenticated from here on.
+		 */
+		if (ctx->adopted && rewrite_store(ctx) < 0) {
+			int err = errno;
+			close_bootinfo(ctx);
+			errno = err;
+			return -1;
+		}
 		*ctxp = ctx;
 		return 0;
 	}
+	if (ctx == NULL)
+		return -1;
+	if (ctx->readonly) {
+		close_bootinfo(ctx);
+		errno = EIO;
+		return -1;
+	}
+	if (ctx->unauthenticated && !ctx->adopted) {
+		close_bootinfo(ctx);
+		errno = EKEYREJECTED;
+		return -1;
+	}
 	/*
 	 * Initialization code below here.
 	 *
 	 *
 	 * Preserve variables that begin with an underscore.
-	 * The linked list we build here gets reused in the new
-	 * context we create after initialization as the new variable
-	 * list.
+	 * The linked list we build here gets reused in the
+	 * context as the new variable list once the in-storage
+	 * copies have been cleared.
 	 */
-	if (ctx != NULL) {
-		struct info_var *prev = NULL;
-		for (var = ctx->vars; var != NULL; var = var->next) {
-			if (*var->name == '_') {
-				struct info_var *varcopy;
-				size_t namelen = strlen(var->name);
-				size_t vallen = strlen(var->value);
-				varcopy = calloc(1, sizeof(*var) + namelen + vallen + 2);
-				if (varcopy == NULL) {
-					close_bootinfo(ctx, false);
-					*ctxp = NULL;
-					return -1;
-				}
-				varcopy->name = (char *)(varcopy + 1);
-				memcpy(varcopy->name, var->name, namelen);
-				varcopy->value = varcopy->name + namelen + 1;
-				memcpy(varcopy->value, var->value, vallen);
-				if (prev == NULL)
-					prev = preserve_list = varcopy;
-				else
-					prev->next = varcopy;
-				prev = varcopy;
+	for (var = ctx->vars, prev = NULL; var != NULL; var = var->next) {
+		if (*var->name == '_') {
+			struct info_var *varcopy;
+			size_t namelen = strlen(var->name);
+			size_t vallen = strlen(var->value);
+			varcopy = calloc(1, sizeof(*var) + namelen + vallen + 2);
+			if (varcopy == NULL) {
+				free_vars(preserve_list);
+				close_bootinfo(ctx);
+				return -1;
 			}
+			varcopy->name = (char *)(varcopy + 1);
+			memcpy(varcopy->name, var->name, namelen);
+			varcopy->value = varcopy->name + namelen + 1;
+			memcpy(varcopy->value, var->value, vallen);
+			if (prev == NULL)
+				preserve_list = varcopy;
+			else
+				prev->next = varcopy;
+			prev = varcopy;
 		}
-		lockfd = close_bootinfo(ctx, true);
-	} else
-		lockfd = -1;
-
-	buf = calloc(1, DEVINFO_BLOCK_SIZE + EXTENSION_SIZE);
-	if (buf == NULL)
-		goto error_depart;
-	reset_bootdev = set_bootdev_writeable_status(devinfo_dev, true);
-	fd = open(devinfo_dev, O_RDWR|O_DSYNC);
-	if (fd < 0)
-		goto error_depart;
-	/*
-	 * Initialize the header block in both copies
-	 */
-	for (i = 0; i < 2; i++) {
-		if (lseek(fd, devinfo_offset[i], SEEK_SET) < 0)
-			break;
-		for (n = 0; n < DEVINFO_BLOCK_SIZE; n += cnt) {
-			cnt = write(fd, buf+n, DEVINFO_BLOCK_SIZE-n);
-			if (cnt < 0)
-				break;
-		}
-		if (n < DEVINFO_BLOCK_SIZE)
-			break;
-		if (lseek(fd, extension_offset[i], SEEK_SET) < 0)
-			break;
-		for (n = 0; n < EXTENSION_SIZE; n += cnt) {
-			cnt = write(fd, buf+DEVINFO_BLOCK_SIZE+n, EXTENSION_SIZE-n);
-			if (cnt < 0)
-				break;
-		}
-		if (n < EXTENSION_SIZE)
-			break;
-	}
-	/*
-	 * Both header block writes must succeed
-	 */
-	if (i < 2) {
-		errno = EIO;
-		goto error_depart;
 	}
-
-	ctx = calloc(1, sizeof(struct devinfo_context));
-	if (ctx == NULL)
-		goto error_depart;
-	ctx->fd = fd;
-	ctx->lockfd = lockfd;
-	ctx->current = -1;
+	free_vars(ctx->vars);
 	ctx->vars = preserve_list;
+
+	sernum = (ctx->current < 0 ? 0 : ctx->curinfo.sernum);
+	memset(&ctx->curinfo, 0, sizeof(ctx->curinfo));
+	ctx->curinfo.sernum = sernum;
+	if (rewrite_store(ctx) < 0) {
+		int err = errno;
+		close_bootinfo(ctx);
+		errno = err;
+		return -1;
+	}
 	*ctxp = ctx;
-	free(buf);
-	return bootinfo_update(ctx);
+	return 0;
 
-  error_depart:
-	if (fd >= 0)
-		close(fd);
-	if (lockfd >= 0)
-		close(lockfd);
-	if (reset_bootdev)
-		set_bootdev_writeable_status(devinfo_dev, false);
-	if (buf != NULL)
-		free(buf);
-	if (ctx != NULL)
-		free(ctx);
-	*ctxp = NULL;
-	free_vars(preserve_list);
-	return -1;
+} /* bootinfo_open_store */
 
+/*
+ * bootinfo_open
+ *
+ * Opens a context for the default store.
+ */
+int
+bootinfo_open (struct devinfo_context **ctxp, unsigned int flags)
+{
+	return bootinfo_open_store(ctxp, NULL, flags);
 
 } /* bootinfo_open */
 
+/*
+ * bootinfo_store_name
+ *
+ * Returns the name of the store a context was opened on.
+ */
+const char *
+bootinfo_store_name (struct devinfo_context *ctx)
+{
+	if (ctx == NULL) {
+		errno = EINVAL;
+		return NULL;
+	}
+	return ctx->store->name;
+
+} /* bootinfo_store_name */
+
 /*
  * bootinfo_mark_successful
  *
@@ -703,11 +1589,13 @@ bootinfo_mark_successful (struct devinfo_context *ctx,
 	else if (ctx->readonly)
 		errno = EROFS;
 	else {
+		pthread_mutex_lock(&ctx->lock);
 		ctx->curinfo.flags &= ~FLAG_BOOT_IN_PROGRESS;
 		if (failed_boot_count != NULL)
 			*failed_boot_count = ctx->curinfo.failed_boots;
 		ctx->curinfo.failed_boots = 0;
-		ret = bootinfo_update(ctx);
+		ret = update_bootinfo(ctx);
+		pthread_mutex_unlock(&ctx->lock);
 	}
 
 	return ret;
@@ -739,13 +1627,15 @@ bootinfo_mark_in_progress (struct devinfo_context *ctx,
 	else if (ctx->readonly)
 		errno = EROFS;
 	else {
+		pthread_mutex_lock(&ctx->lock);
 		if (ctx->curinfo.flags & FLAG_BOOT_IN_PROGRESS)
 			ctx->curinfo.failed_boots += 1;
 		else
 			ctx->curinfo.flags |= FLAG_BOOT_IN_PROGRESS;
 		if (failed_boot_count != NULL)
 			*failed_boot_count = ctx->curinfo.failed_boots;
-		ret = bootinfo_update(ctx);
+		ret = update_bootinfo(ctx);
+		pthread_mutex_unlock(&ctx->lock);
 	}
 	return ret;
 
@@ -758,41 +1648,61 @@ bootinfo_mark_in_progress (struct devinfo_context *ctx,
 int
 bootinfo_is_in_progress (struct devinfo_context *ctx)
 {
+	int ret;
+
 	if (ctx == NULL) {
 		errno = EINVAL;
 		return -1;
 	}
-	return (ctx->curinfo.flags & FLAG_BOOT_IN_PROGRESS) != 0 ? 1 : 0;
+	pthread_mutex_lock(&ctx->lock);
+	ret = (ctx->curinfo.flags & FLAG_BOOT_IN_PROGRESS) != 0 ? 1 : 0;
+	pthread_mutex_unlock(&ctx->lock);
+	return ret;
 }
 
 int
 bootinfo_devinfo_version (struct devinfo_context *ctx)
 {
+	int ret;
+
 	if (ctx == NULL) {
 		errno = EINVAL;
 		return -1;
 	}
-	return (int) ctx->curinfo.devinfo_version;
+	pthread_mutex_lock(&ctx->lock);
+	ret = (int) ctx->curinfo.devinfo_version;
+	pthread_mutex_unlock(&ctx->lock);
+	return ret;
 }
 
 int
 bootinfo_failed_boot_count (struct devinfo_context *ctx)
 {
+	int ret;
+
 	if (ctx == NULL) {
 		errno = EINVAL;
 		return -1;
 	}
-	return (int) ctx->curinfo.failed_boots;
+	pthread_mutex_lock(&ctx->lock);
+	ret = (int) ctx->curinfo.failed_boots;
+	pthread_mutex_unlock(&ctx->lock);
+	return ret;
 }
 
 int
 bootinfo_extension_sectors (struct devinfo_context *ctx)
 {
+	int ret;
+
 	if (ctx == NULL) {
 		errno = EINVAL;
 		return -1;
 	}
-	return (int) ctx->curinfo.ext_sectors;
+	pthread_mutex_lock(&ctx->lock);
+	ret = (int) ctx->curinfo.ext_sectors;
+	pthread_mutex_unlock(&ctx->lock);
+	return ret;
 }
 
 /*
@@ -803,6 +1713,8 @@ bootinfo_extension_sectors (struct devinfo_context *ctx)
  * do not modify it, or call any other function in the
  * bootinfo_bootvar API, between calls - you must restart
  * the iteration from the beginning in that case.
+ * Not safe against concurrent updates from other threads;
+ * use bootinfo_snapshot_get for that.
  *
  * Negative return code on error.
  * Zero return code on success, with name and value set to NULL
@@ -842,6 +1754,8 @@ bootinfo_bootvar_iterate (struct devinfo_context *ctx,
  * The returned value pointer is to a null-terminated
  * printable character string and should be treated
  * as read-only and not freeable.
+ * Like bootinfo_bootvar_iterate, not safe against
+ * concurrent updates from other threads.
  */
 int
 bootinfo_bootvar_get (struct devinfo_context *ctx,
@@ -875,7 +1789,8 @@ bootinfo_bootvar_get (struct devinfo_context *ctx,
  * Sets or deletes a variable. To delete, either pass NULL as
  * the value pointer, or use a null string as the value.
  * Caller must call bootinfo_update() to finalize the set
- * before freeing the name or value strings.
+ * (or bootinfo_revert() to discard it) before freeing the
+ * name or value strings.
  *
  */
 int
@@ -936,25 +1851,35 @@ bootinfo_bootvar_set (struct devinfo_context *ctx, const char *name,
 	if (value != NULL) {
 		size_t vallen = strlen(value);
 		size_t s = strlen(name) + vallen + 2;
-		if (vallen >= MAX_VALUE_SIZE ||
-		    ctx->varsize + s > MAX_VALUE_SIZE) {
+		/*
+		 * Maximum size for a variable value is all of the variable
+		 * space minus two bytes for null terminators (for name and
+		 * value) and one byte for a name, plus one byte for the null
+		 * character terminating the variable list.
+		 */
+		if (vallen >= ctx->varspace - 4 ||
+		    ctx->varsize + s > ctx->varspace - 4) {
 			errno = EMSGSIZE;
 			return -1;
 		}
 	}
 
+	pthread_mutex_lock(&ctx->lock);
 	for (var = ctx->vars, prev = NULL;
 	     var != NULL && strcmp(name, var->name) != 0;
 	     prev = var, var = var->next);
 
 	if (var == NULL) {
 		if (value == NULL) {
+			pthread_mutex_unlock(&ctx->lock);
 			errno = ENOENT;
 			return -1;
 		}
 		var = calloc(1, sizeof(struct info_var));
-		if (var == NULL)
+		if (var == NULL) {
+			pthread_mutex_unlock(&ctx->lock);
 			return -1;
+		}
 		var->name = (char *) name;
 		var->value = (char *) value;
 		/* Add to end of list */
@@ -972,7 +1897,228 @@ bootinfo_bootvar_set (struct devinfo_context *ctx, const char *name,
 	} else
 		/* Changing value of found variable */
 		var->value = (char *) value;
+	pthread_mutex_unlock(&ctx->lock);
 
 	return 0;
 
 } /* bootinfo_bootvar_set */
+
+/*
+ * bootinfo_snapshot_get
+ *
+ * Returns a reference to an immutable snapshot of the
+ * committed variables.  Snapshots are safe to use from
+ * any thread, and remain valid (with their original
+ * contents) after later commits, or after the context
+ * is closed, until released with bootinfo_snapshot_put.
+ * Each successful bootinfo_update publishes a new one.
+ */
+struct bootinfo_snapshot *
+bootinfo_snapshot_get (struct devinfo_context *ctx)
+{
+	struct bootinfo_snapshot *snap;
+
+	if (ctx == NULL) {
+		errno = EINVAL;
+		return NULL;
+	}
+	pthread_mutex_lock(&ctx->snaplock);
+	snap = ctx->snapshot;
+	if (snap != NULL)
+		atomic_fetch_add(&snap->refcount, 1);
+	pthread_mutex_unlock(&ctx->snaplock);
+	if (snap != NULL)
+		return snap;
+
+	/*
+	 * First use (or an earlier allocation failure): build
+	 * the snapshot under the context lock, unless another
+	 * thread got there first.
+	 */
+	pthread_mutex_lock(&ctx->lock);
+	if (ctx->snapshot == NULL)
+		publish_snapshot(ctx);
+	pthread_mutex_lock(&ctx->snaplock);
+	snap = ctx->snapshot;
+	if (snap != NULL)
+		atomic_fetch_add(&snap->refcount, 1);
+	pthread_mutex_unlock(&ctx->snaplock);
+	pthread_mutex_unlock(&ctx->lock);
+	if (snap == NULL)
+		errno = ENOMEM;
+	return snap;
+
+} /* bootinfo_snapshot_get */
+
+/*
+ * bootinfo_snapshot_put
+ *
+ * Releases a reference to a snapshot.
+ */
+void
+bootinfo_snapshot_put (struct bootinfo_snapshot *snap)
+{
+	if (snap != NULL && atomic_fetch_sub(&snap->refcount, 1) == 1)
+		free(snap);
+
+} /* bootinfo_snapshot_put */
+
+/*
+ * bootinfo_snapshot_count
+ *
+ * Returns the number of variables in a snapshot.
+ */
+int
+bootinfo_snapshot_count (struct bootinfo_snapshot *snap)
+{
+	if (snap == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	return (int) snap->count;
+
+} /* bootinfo_snapshot_count */
+
+/*
+ * bootinfo_snapshot_var_at
+ *
+ * Retrieves a variable from a snapshot by its index
+ * (in storage order), for iterating through the
+ * variables.  Name and value point into the snapshot.
+ */
+int
+bootinfo_snapshot_var_at (struct bootinfo_snapshot *snap, unsigned int index,
+			  const char **name, const char **value)
+{
+	if (snap == NULL || name == NULL || value == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (index >= snap->count) {
+		errno = ENOENT;
+		return -1;
+	}
+	*name = snap->vars[index].name;
+	*value = snap->vars[index].value;
+	return 0;
+
+} /* bootinfo_snapshot_var_at */
+
+/*
+ * bootinfo_snapshot_var_get
+ *
+ * Retrieves a single variable from a snapshot by name.
+ * The value points into the snapshot.
+ */
+int
+bootinfo_snapshot_var_get (struct bootinfo_snapshot *snap, const char *name,
+			   const char **value)
+{
+	struct snapshot_var key, *var;
+
+	if (snap == NULL || name == NULL || value == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	key.name = name;
+	var = bsearch(&key, snap->byname, snap->count, sizeof(struct snapshot_var),
+		      snapshot_compare);
+	if (var == NULL) {
+		errno = ENOENT;
+		return -1;
+	}
+	*value = var->value;
+	return 0;
+
+} /* bootinfo_snapshot_var_get */
+
+/*
+ * bootinfo_open_image
+ *
+ * Opens a context for examining the copies of a store in
+ * an image file (or a device), using the named store's
+ * layout.  The context is read-only and no locks are taken.
+ * Unlike bootinfo_open_store, a context is returned even
+ * if neither copy is valid, so the copies can be inspected.
+ * An authenticated store's HMACs are checked only if its
+ * key is available.
+ */
+int
+bootinfo_open_image (struct devinfo_context **ctxp, const char *path,
+		     const char *storename)
+{
+	const struct bootinfo_store *store;
+	struct devinfo_context *ctx;
+
+	if (ctxp == NULL || path == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	*ctxp = NULL;
+	store = find_store(storename);
+	if (store == NULL)
+		return -1;
+	ctx = alloc_context(store, true);
+	if (ctx == NULL)
+		return -1;
+	if (store->hmac_key != NULL)
+		ctx->hmacfd = hmac_open(store->hmac_key);
+	ctx->fd = open(path, O_RDONLY|O_CLOEXEC);
+	if (ctx->fd < 0) {
+		close_bootinfo(ctx);
+		return -1;
+	}
+	read_copies(ctx);
+	select_current(ctx);
+	*ctxp = ctx;
+	return 0;
+
+} /* bootinfo_open_image */
+
+/*
+ * bootinfo_copy_status
+ *
+ * Returns the status of one copy of the store,
+ * as found when the context was opened.
+ */
+int
+bootinfo_copy_status (struct devinfo_context *ctx, unsigned int copy,
+		      struct bootinfo_copy_status *status)
+{
+	if (ctx == NULL || copy >= OFFSET_COUNT || status == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	*status = ctx->copystat[copy];
+	return 0;
+
+} /* bootinfo_copy_status */
+
+/*
+ * bootinfo_copy_snapshot
+ *
+ * Returns a snapshot of the variables in one copy of
+ * the store, whether or not it is current.  Fails with
+ * ENODATA if the copy did not pass its CRC checks.
+ */
+struct bootinfo_snapshot *
+bootinfo_copy_snapshot (struct devinfo_context *ctx, unsigned int copy)
+{
+	struct bootinfo_snapshot *snap;
+
+	if (ctx == NULL || copy >= OFFSET_COUNT) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if (!(ctx->copystat[copy].header_crc_ok && ctx->copystat[copy].ext_crc_ok)) {
+		errno = ENODATA;
+		return NULL;
+	}
+	pthread_mutex_lock(&ctx->lock);
+	snap = build_snapshot((char *) ctx->infobuf[copy] + DEVINFO_HDR_SIZE, ctx->varspace);
+	pthread_mutex_unlock(&ctx->lock);
+	if (snap == NULL)
+		errno = ENOMEM;
+	return snap;
+
+} /* bootinfo_copy_snapshot */
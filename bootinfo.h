@@ -2,16 +2,38 @@
 #define bootinfo_h_included
 /* Copyright (c) 2022, Matthew Madison */
 
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 struct devinfo_context;
 typedef struct devinfo_context bootinfo_ctx_t;
+struct bootinfo_snapshot;
+typedef struct bootinfo_snapshot bootinfo_snapshot_t;
 
 /*
  * Flags for bootinfo_open
  */
 #define BOOTINFO_O_RDONLY	(1U<<0)
 #define BOOTINFO_O_FORCE_INIT	(1U<<1)
+#define BOOTINFO_O_AUTHENTICATE	(1U<<2)
+
+/*
+ * Name of the store used by bootinfo_open
+ */
+#define BOOTINFO_DEFAULT_STORE	"default"
+
+/*
+ * Description of the store authentication key
+ * that keystoretool manages in the user keyring
+ */
+#define BOOTINFO_HMAC_KEY_NAME	"bootinfo-hmac"
 
 int bootinfo_open(bootinfo_ctx_t **ctxp, unsigned int flags);
+int bootinfo_open_store(bootinfo_ctx_t **ctxp, const char *store, unsigned int flags);
+const char *bootinfo_store_name(bootinfo_ctx_t *ctx);
 int bootinfo_mark_successful(bootinfo_ctx_t *ctx, unsigned int *failed_boot_count);
 int bootinfo_mark_in_progress(bootinfo_ctx_t *ctx, unsigned int *failed_boot_count);
 int bootinfo_is_in_progress(bootinfo_ctx_t *ctx);
@@ -22,6 +44,49 @@ int bootinfo_bootvar_iterate(bootinfo_ctx_t *ctx, void **iterctx, char **name, c
 int bootinfo_bootvar_get(bootinfo_ctx_t *ctx, const char *name, char **value);
 int bootinfo_bootvar_set(bootinfo_ctx_t *ctx, const char *name, const char *value);
 int bootinfo_update(bootinfo_ctx_t *ctx);
+int bootinfo_revert(bootinfo_ctx_t *ctx);
 void bootinfo_close(bootinfo_ctx_t *ctx);
 
+/*
+ * Thread-safe, reference-counted read snapshots
+ */
+bootinfo_snapshot_t *bootinfo_snapshot_get(bootinfo_ctx_t *ctx);
+void bootinfo_snapshot_put(bootinfo_snapshot_t *snap);
+int bootinfo_snapshot_count(bootinfo_snapshot_t *snap);
+int bootinfo_snapshot_var_at(bootinfo_snapshot_t *snap, unsigned int index,
+			     const char **name, const char **value);
+int bootinfo_snapshot_var_get(bootinfo_snapshot_t *snap, const char *name,
+			      const char **value);
+
+/*
+ * Examining store images (or devices) offline.  A context
+ * opened with bootinfo_open_image is read-only and takes
+ * no locks; the status of each copy of the store is as
+ * found when the context was opened.
+ */
+#define BOOTINFO_COPY_COUNT	2
+struct bootinfo_copy_status {
+	off_t offset;
+	int readable;
+	int magic_ok;
+	unsigned int version;
+	unsigned int ext_sectors;
+	int header_crc_ok;
+	int ext_crc_ok;
+	int hmac_ok;		/* -1 if not checked */
+	int valid;
+	int current;
+	unsigned int sernum;
+	unsigned int flags;
+	unsigned int failed_boots;
+};
+int bootinfo_open_image(bootinfo_ctx_t **ctxp, const char *path, const char *store);
+int bootinfo_copy_status(bootinfo_ctx_t *ctx, unsigned int copy,
+			 struct bootinfo_copy_status *status);
+bootinfo_snapshot_t *bootinfo_copy_snapshot(bootinfo_ctx_t *ctx, unsigned int copy);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* bootinfo_h_included */
@@ -0,0 +1,321 @@
+#ifndef bootinfo_hpp_included
+#define bootinfo_hpp_included
+/*
+ * bootinfo.hpp
+ *
+ * Header-only C++17 interface to the bootinfo library.
+ *
+ * Lookups and iteration hand back std::string_views into
+ * the context's own buffer, with no copying; the views stay
+ * valid until the next commit on the context (or until it
+ * is closed).  Snapshots give views that stay valid for as
+ * long as the snapshot object is held, and can be used from
+ * any thread.  Errors are reported by throwing
+ * std::system_error.
+ *
+ * Copyright (c) 2022, Matthew Madison
+ */
+
+#include <cerrno>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+#include "bootinfo.h"
+
+namespace bootinfo {
+
+using variable = std::pair<std::string_view, std::string_view>;
+
+[[noreturn]] inline void
+throw_errno (const char *what)
+{
+	throw std::system_error(errno, std::generic_category(), what);
+}
+
+/*
+ * var_iterator
+ *
+ * Forward iterator over the variables in a context.
+ */
+class var_iterator {
+public:
+	using iterator_category = std::forward_iterator_tag;
+	using value_type = variable;
+	using difference_type = std::ptrdiff_t;
+	using pointer = const variable *;
+	using reference = const variable &;
+
+	var_iterator () = default;
+	explicit var_iterator (bootinfo_ctx_t *ctx) : ctx_(ctx) { advance(); }
+
+	reference operator* () const { return var_; }
+	pointer operator-> () const { return &var_; }
+	var_iterator &operator++ () { advance(); return *this; }
+	var_iterator operator++ (int) { var_iterator tmp = *this; advance(); return tmp; }
+	bool operator== (const var_iterator &other) const { return iterctx_ == other.iterctx_; }
+	bool operator!= (const var_iterator &other) const { return iterctx_ != other.iterctx_; }
+
+private:
+	void advance ()
+	{
+		char *name, *value;
+		if (bootinfo_bootvar_iterate(ctx_, &iterctx_, &name, &value) < 0)
+			throw_errno("bootinfo_bootvar_iterate");
+		if (name == nullptr) {
+			ctx_ = nullptr;
+			iterctx_ = nullptr;
+			var_ = variable();
+		} else
+			var_ = variable(name, value);
+	}
+
+	bootinfo_ctx_t *ctx_ = nullptr;
+	void *iterctx_ = nullptr;
+	variable var_;
+};
+
+/*
+ * snapshot
+ *
+ * Holds a reference to an immutable snapshot of
+ * the committed variables.
+ */
+class snapshot {
+public:
+	class iterator {
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = variable;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const variable *;
+		using reference = variable;
+
+		iterator (bootinfo_snapshot_t *snap, unsigned int index) : snap_(snap), index_(index) { }
+		variable operator* () const
+		{
+			const char *name, *value;
+			if (bootinfo_snapshot_var_at(snap_, index_, &name, &value) < 0)
+				throw_errno("bootinfo_snapshot_var_at");
+			return variable(name, value);
+		}
+		iterator &operator++ () { ++index_; return *this; }
+		iterator operator++ (int) { iterator tmp = *this; ++index_; return tmp; }
+		bool operator== (const iterator &other) const { return index_ == other.index_; }
+		bool operator!= (const iterator &other) const { return index_ != other.index_; }
+
+	private:
+		bootinfo_snapshot_t *snap_;
+		unsigned int index_;
+	};
+
+	explicit snapshot (bootinfo_snapshot_t *snap) : snap_(snap) { }
+	snapshot (const snapshot &) = delete;
+	snapshot &operator= (const snapshot &) = delete;
+	snapshot (snapshot &&other) noexcept : snap_(std::exchange(other.snap_, nullptr)) { }
+	snapshot &operator= (snapshot &&other) noexcept
+	{
+		if (this != &other) {
+			bootinfo_snapshot_put(snap_);
+			snap_ = std::exchange(other.snap_, nullptr);
+		}
+		return *this;
+	}
+	~snapshot () { bootinfo_snapshot_put(snap_); }
+
+	/*
+	 * Lookups need a null-terminated name, so
+	 * take a C string rather than a string_view.
+	 */
+	std::optional<std::string_view> get (const char *name) const
+	{
+		const char *value;
+		if (bootinfo_snapshot_var_get(snap_, name, &value) < 0) {
+			if (errno == ENOENT)
+				return std::nullopt;
+			throw_errno("bootinfo_snapshot_var_get");
+		}
+		return std::string_view(value);
+	}
+	std::optional<std::string_view> get (const std::string &name) const { return get(name.c_str()); }
+
+	std::size_t size () const { return static_cast<std::size_t>(bootinfo_snapshot_count(snap_)); }
+	iterator begin () const { return iterator(snap_, 0); }
+	iterator end () const { return iterator(snap_, static_cast<unsigned int>(size())); }
+
+private:
+	bootinfo_snapshot_t *snap_;
+};
+
+/*
+ * context
+ *
+ * Owns an open bootinfo context.
+ */
+class context {
+public:
+	explicit context (unsigned int flags = 0, const char *store = nullptr)
+	{
+		if (bootinfo_open_store(&ctx_, store, flags) < 0) {
+			int err = errno;
+			/*
+			 * A failed open can still hand back a context
+			 * (for example, when no valid copy was found).
+			 */
+			if (ctx_ != nullptr)
+				bootinfo_close(ctx_);
+			errno = err;
+			throw_errno("bootinfo_open_store");
+		}
+	}
+	context (const context &) = delete;
+	context &operator= (const context &) = delete;
+	context (context &&other) noexcept : ctx_(std::exchange(other.ctx_, nullptr)) { }
+	context &operator= (context &&other) noexcept
+	{
+		if (this != &other) {
+			if (ctx_ != nullptr)
+				bootinfo_close(ctx_);
+			ctx_ = std::exchange(other.ctx_, nullptr);
+		}
+		return *this;
+	}
+	~context () { if (ctx_ != nullptr) bootinfo_close(ctx_); }
+
+	bootinfo_ctx_t *get_ctx () const noexcept { return ctx_; }
+
+	/*
+	 * Lookup by walking the variable list, so that the name
+	 * does not have to be null-terminated, and so that changes
+	 * not yet committed are seen.  This is O(n) in the number
+	 * of variables; for repeated lookups of committed values,
+	 * take a snapshot() and use its get(), which does a binary
+	 * search of the snapshot's sorted index.
+	 */
+	std::optional<std::string_view> get (std::string_view name) const
+	{
+		for (const auto &var : *this)
+			if (var.first == name)
+				return var.second;
+		return std::nullopt;
+	}
+
+	var_iterator begin () const { return var_iterator(ctx_); }
+	var_iterator end () const { return var_iterator(); }
+
+	bootinfo::snapshot snapshot () const
+	{
+		bootinfo_snapshot_t *snap = bootinfo_snapshot_get(ctx_);
+		if (snap == nullptr)
+			throw_errno("bootinfo_snapshot_get");
+		return bootinfo::snapshot(snap);
+	}
+
+	bool in_progress () const { return check(bootinfo_is_in_progress(ctx_), "bootinfo_is_in_progress") != 0; }
+	int failed_boot_count () const { return check(bootinfo_failed_boot_count(ctx_), "bootinfo_failed_boot_count"); }
+	int devinfo_version () const { return check(bootinfo_devinfo_version(ctx_), "bootinfo_devinfo_version"); }
+	int extension_sectors () const { return check(bootinfo_extension_sectors(ctx_), "bootinfo_extension_sectors"); }
+
+	unsigned int mark_successful ()
+	{
+		unsigned int count;
+		check(bootinfo_mark_successful(ctx_, &count), "bootinfo_mark_successful");
+		return count;
+	}
+	unsigned int mark_in_progress ()
+	{
+		unsigned int count;
+		check(bootinfo_mark_in_progress(ctx_, &count), "bootinfo_mark_in_progress");
+		return count;
+	}
+
+private:
+	static int check (int ret, const char *what)
+	{
+		if (ret < 0)
+			throw_errno(what);
+		return ret;
+	}
+
+	bootinfo_ctx_t *ctx_ = nullptr;
+};
+
+/*
+ * transaction
+ *
+ * Collects variable changes and applies them to the context
+ * with a single update.  Changes are committed when the
+ * transaction goes out of scope, unless cancel() was called
+ * (or the scope is left by an exception); call commit()
+ * explicitly to see errors.
+ */
+class transaction {
+public:
+	explicit transaction (context &ctx) : ctx_(ctx), uncaught_(std::uncaught_exceptions()) { }
+	transaction (const transaction &) = delete;
+	transaction &operator= (const transaction &) = delete;
+	~transaction ()
+	{
+		if (done_ || std::uncaught_exceptions() > uncaught_)
+			return;
+		try {
+			commit();
+		} catch (...) {
+		}
+	}
+
+	transaction &set (std::string_view name, std::string_view value)
+	{
+		changes_.emplace_back(std::string(name), std::string(value));
+		return *this;
+	}
+	transaction &erase (std::string_view name) { return set(name, std::string_view()); }
+
+	void commit ()
+	{
+		done_ = true;
+		for (const auto &change : changes_) {
+			if (bootinfo_bootvar_set(ctx_.get_ctx(), change.first.c_str(),
+						 change.second.empty() ? nullptr : change.second.c_str()) < 0 &&
+			    !(change.second.empty() && errno == ENOENT))
+				fail("bootinfo_bootvar_set");
+		}
+		if (bootinfo_update(ctx_.get_ctx()) < 0)
+			fail("bootinfo_update");
+		changes_.clear();
+	}
+
+	void cancel () noexcept
+	{
+		done_ = true;
+		changes_.clear();
+	}
+
+private:
+	/*
+	 * The context must not be left holding pointers
+	 * to our strings, so back out the partial changes.
+	 */
+	[[noreturn]] void fail (const char *what)
+	{
+		int err = errno;
+		bootinfo_revert(ctx_.get_ctx());
+		changes_.clear();
+		errno = err;
+		throw_errno(what);
+	}
+
+	context &ctx_;
+	std::vector<std::pair<std::string, std::string>> changes_;
+	int uncaught_;
+	bool done_ = false;
+};
+
+} // namespace bootinfo
+
+#endif /* bootinfo_hpp_included */
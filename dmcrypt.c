@@ -0,0 +1,182 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * dmcrypt.c
+ *
+ * Sets up plain dm-crypt mappings directly through the
+ * device-mapper ioctl interface, with the volume key
+ * referenced by its description in the kernel keyring,
+ * so it never has to be handled in user space.
+ *
+ * Copyright (c) 2022, Matthew Madison
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+#include <linux/dm-ioctl.h>
+#include "dmcrypt.h"
+
+#define DM_DEVDIR "/dev/" DM_DIR
+#define DM_CONTROL DM_DEVDIR "/" DM_CONTROL_NODE
+
+/*
+ * Buffer for an ioctl request with a single target,
+ * laid out as the dm_ioctl header, the target spec,
+ * and the target parameters.
+ */
+union dm_request {
+	struct dm_ioctl io;
+	uint8_t buf[sizeof(struct dm_ioctl) + sizeof(struct dm_target_spec) + 1024];
+};
+
+/*
+ * dm_init
+ *
+ * Initializes the dm_ioctl header for a request.
+ */
+static void
+dm_init (union dm_request *req, size_t size, const char *name)
+{
+	memset(req, 0, size);
+	req->io.version[0] = DM_VERSION_MAJOR;
+	req->io.version[1] = 0;
+	req->io.version[2] = 0;
+	req->io.data_size = size;
+	req->io.data_start = sizeof(req->io);
+	strcpy(req->io.name, name);
+
+} /* dm_init */
+
+/*
+ * dm_remove
+ *
+ * Removes a partially set up mapping, preserving errno.
+ */
+static void
+dm_remove (int ctlfd, const char *name)
+{
+	union dm_request req;
+	int save_errno = errno;
+
+	dm_init(&req, sizeof(req.io), name);
+	ioctl(ctlfd, DM_DEV_REMOVE, &req.io);
+	errno = save_errno;
+
+} /* dm_remove */
+
+/*
+ * dmcrypt_activate
+ *
+ * Creates a dm-crypt mapping covering all of a device.
+ *
+ * name: name of the mapping (device node in /dev/mapper)
+ * device: path to the underlying block device
+ * cipher: cipher specification, as for dm-crypt
+ * keyspec: key reference, as for dm-crypt, in the form
+ *          :<key size>:<key type>:<key description>
+ *
+ * The node in /dev/mapper is created here if it does not
+ * already exist, for use without udev.  On any failure after
+ * the mapping is created, it is removed again.
+ *
+ * dm-crypt rejects a table with EINVAL if the kernel does not
+ * support the key type named in keyspec (encrypted and trusted
+ * keys are not supported by older kernels); for those key types,
+ * that error is returned as EOPNOTSUPP, so callers can tell it
+ * apart from other failures.
+ *
+ * Returns: 0 on success, -1 on error (errno set).
+ */
+int
+dmcrypt_activate (const char *name, const char *device,
+		  const char *cipher, const char *keyspec)
+{
+	union dm_request req;
+	struct dm_target_spec *spec;
+	char *params, path[sizeof(DM_DEVDIR) + DM_NAME_LEN + 1];
+	size_t paramsize;
+	uint64_t devsize;
+	dev_t dev;
+	int fd, n;
+
+	if (strlen(name) >= DM_NAME_LEN) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	fd = open(device, O_RDONLY|O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	n = ioctl(fd, BLKGETSIZE64, &devsize);
+	close(fd);
+	if (n < 0)
+		return -1;
+	if (devsize < 512) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	fd = open(DM_CONTROL, O_RDWR|O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	dm_init(&req, sizeof(req.io), name);
+	if (ioctl(fd, DM_DEV_CREATE, &req.io) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	dm_init(&req, sizeof(req), name);
+	req.io.target_count = 1;
+	spec = (struct dm_target_spec *) &req.buf[sizeof(req.io)];
+	spec->sector_start = 0;
+	spec->length = devsize >> 9;
+	strcpy(spec->target_type, "crypt");
+	params = (char *)(spec + 1);
+	paramsize = sizeof(req) - sizeof(req.io) - sizeof(*spec);
+	n = snprintf(params, paramsize, "%s %s 0 %s 0", cipher, keyspec, device);
+	if (n < 0 || (size_t) n >= paramsize) {
+		errno = E2BIG;
+		dm_remove(fd, name);
+		close(fd);
+		return -1;
+	}
+	spec->next = sizeof(*spec) + ((n + 8) & ~7);
+	if (ioctl(fd, DM_TABLE_LOAD, &req.io) < 0) {
+		if (errno == EINVAL &&
+		    (strstr(keyspec, ":encrypted:") != NULL ||
+		     strstr(keyspec, ":trusted:") != NULL))
+			errno = EOPNOTSUPP;
+		dm_remove(fd, name);
+		close(fd);
+		return -1;
+	}
+	/*
+	 * Resuming the (initially suspended) device
+	 * makes the loaded table live.
+	 */
+	dm_init(&req, sizeof(req.io), name);
+	if (ioctl(fd, DM_DEV_SUSPEND, &req.io) < 0) {
+		dm_remove(fd, name);
+		close(fd);
+		return -1;
+	}
+
+	dev = (dev_t) req.io.dev;
+	sprintf(path, "%s/%s", DM_DEVDIR, name);
+	if (mknod(path, S_IFBLK|S_IRUSR|S_IWUSR, dev) < 0 && errno != EEXIST) {
+		dm_remove(fd, name);
+		close(fd);
+		return -1;
+	}
+	close(fd);
+	return 0;
+
+} /* dmcrypt_activate */
@@ -0,0 +1,8 @@
+#ifndef dmcrypt_h_included
+#define dmcrypt_h_included
+/* Copyright (c) 2022, Matthew Madison */
+
+int dmcrypt_activate(const char *name, const char *device,
+		     const char *cipher, const char *keyspec);
+
+#endif /* dmcrypt_h_included */
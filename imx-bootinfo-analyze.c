@@ -0,0 +1,468 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * imx-bootinfo-analyze.c
+ *
+ * Offline analyzer for bootinfo variable stores in raw
+ * boot partition images.  For each image, reports the
+ * status of both copies of the store (checks passed,
+ * serial number, and so on), which copy would be used,
+ * and the variables that differ between the copies,
+ * as JSON or CSV.  Images are examined in parallel.
+ *
+ * Copyright (c) 2022, Matthew Madison
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include "bootinfo.h"
+
+static struct option options[] = {
+	{ "store",		required_argument,	0, 'S' },
+	{ "format",		required_argument,	0, 'f' },
+	{ "jobs",		required_argument,	0, 'j' },
+	{ "help",		no_argument,		0, 'h' },
+	{ "version",		no_argument,		0, 0   },
+	{ 0,			0,			0, 0   }
+};
+static const char *shortopts = ":S:f:j:h";
+
+static char *optarghelp[] = {
+	"--store NAME	      ",
+	"--format FMT	      ",
+	"--jobs N	      ",
+	"--help		      ",
+	"--version	      ",
+};
+
+static char *opthelp[] = {
+	"use the layout of the named variable store instead of the default store",
+	"output format: json or csv (default)",
+	"number of images to examine in parallel (default: number of CPUs)",
+	"display this help text",
+	"display version information"
+};
+
+static const char *storename = NULL;
+static bool json_output = false;
+
+/*
+ * Per-image work item.  Each worker formats the report for
+ * an image into its own buffer, so that reports can be
+ * written out in the order the images were given.
+ */
+struct image {
+	const char *path;
+	char *report;
+	size_t reportlen;
+};
+
+static struct image *images;
+static size_t image_count;
+static atomic_size_t next_image;
+
+/*
+ * print_usage
+ */
+static void
+print_usage (void)
+{
+	int i;
+	printf("\nUsage:\n");
+	printf("\timx-bootinfo-analyze [<option>...] [IMAGE...]\n");
+	printf("Image names are read from standard input, one per line, if none are given.\n");
+	printf("Options:\n");
+	for (i = 0; i < sizeof(options)/sizeof(options[0]) && options[i].name != 0; i++) {
+		printf(" %s\t%c%c\t%s\n",
+		       optarghelp[i],
+		       (options[i].val == 0 ? ' ' : '-'),
+		       (options[i].val == 0 ? ' ' : options[i].val),
+		       opthelp[i]);
+	}
+
+} /* print_usage */
+
+/*
+ * json_string
+ *
+ * Writes a JSON string literal, or null.
+ */
+static void
+json_string (FILE *fp, const char *s)
+{
+	if (s == NULL) {
+		fputs("null", fp);
+		return;
+	}
+	fputc('"', fp);
+	for (; *s != '\0'; s++) {
+		if (*s == '"' || *s == '\\')
+			fprintf(fp, "\\%c", *s);
+		else if ((unsigned char) *s < 0x20)
+			fprintf(fp, "\\u%04x", (unsigned char) *s);
+		else
+			fputc(*s, fp);
+	}
+	fputc('"', fp);
+
+} /* json_string */
+
+/*
+ * csv_field
+ *
+ * Writes a CSV field, quoting it if needed.
+ */
+static void
+csv_field (FILE *fp, const char *s)
+{
+	if (strpbrk(s, ",\"\r\n") == NULL) {
+		fputs(s, fp);
+		return;
+	}
+	fputc('"', fp);
+	for (; *s != '\0'; s++) {
+		if (*s == '"')
+			fputc('"', fp);
+		fputc(*s, fp);
+	}
+	fputc('"', fp);
+
+} /* csv_field */
+
+/*
+ * json_bool
+ *
+ * Writes a check result: true, false,
+ * or null for a check that was not made.
+ */
+static const char *
+json_bool (int val)
+{
+	return (val < 0 ? "null" : (val ? "true" : "false"));
+
+} /* json_bool */
+
+/*
+ * csv_bool
+ */
+static const char *
+csv_bool (int val)
+{
+	return (val < 0 ? "" : (val ? "yes" : "no"));
+
+} /* csv_bool */
+
+/*
+ * write_differences
+ *
+ * Writes out (for JSON) the variables that differ between
+ * the two copies, and returns how many there are.
+ */
+static unsigned int
+write_differences (FILE *fp, bootinfo_snapshot_t *snap[BOOTINFO_COPY_COUNT])
+{
+	const char *name, *value, *other;
+	unsigned int count = 0;
+	int i, j, n;
+
+	for (i = 0; i < BOOTINFO_COPY_COUNT; i++) {
+		n = bootinfo_snapshot_count(snap[i]);
+		for (j = 0; j < n; j++) {
+			if (bootinfo_snapshot_var_at(snap[i], j, &name, &value) < 0)
+				break;
+			if (bootinfo_snapshot_var_get(snap[1-i], name, &other) < 0)
+				other = NULL;
+			else if (i == 1 || strcmp(value, other) == 0)
+				/* same value, or already reported from copy A */
+				continue;
+			if (fp != NULL) {
+				fprintf(fp, "%s\n      { \"name\": ", (count == 0 ? "" : ","));
+				json_string(fp, name);
+				fputs(", \"A\": ", fp);
+				json_string(fp, (i == 0 ? value : other));
+				fputs(", \"B\": ", fp);
+				json_string(fp, (i == 0 ? other : value));
+				fputs(" }", fp);
+			}
+			count += 1;
+		}
+	}
+	return count;
+
+} /* write_differences */
+
+/*
+ * analyze_image
+ *
+ * Examines one image, leaving the formatted
+ * report in the image's work item.
+ */
+static void
+analyze_image (struct image *img)
+{
+	bootinfo_ctx_t *ctx;
+	bootinfo_snapshot_t *snap[BOOTINFO_COPY_COUNT] = { NULL, NULL };
+	struct bootinfo_copy_status st[BOOTINFO_COPY_COUNT];
+	FILE *fp;
+	const char *error = NULL;
+	char errbuf[128];
+	char diffs[16] = "";
+	unsigned int i, ndiffs = 0;
+
+	fp = open_memstream(&img->report, &img->reportlen);
+	if (fp == NULL)
+		return;
+	if (bootinfo_open_image(&ctx, img->path, storename) < 0)
+		error = strerror_r(errno, errbuf, sizeof(errbuf));
+	else {
+		for (i = 0; i < BOOTINFO_COPY_COUNT; i++) {
+			bootinfo_copy_status(ctx, i, &st[i]);
+			snap[i] = bootinfo_copy_snapshot(ctx, i);
+		}
+		if (snap[0] != NULL && snap[1] != NULL) {
+			ndiffs = write_differences(NULL, snap);
+			snprintf(diffs, sizeof(diffs), "%u", ndiffs);
+		}
+	}
+
+	if (json_output) {
+		fputs("  {\n    \"file\": ", fp);
+		json_string(fp, img->path);
+		fputs(",\n    \"error\": ", fp);
+		json_string(fp, error);
+		if (error == NULL) {
+			fputs(",\n    \"copies\": [", fp);
+			for (i = 0; i < BOOTINFO_COPY_COUNT; i++) {
+				fprintf(fp, "%s\n      { \"copy\": \"%c\", \"offset\": %lld, \"readable\": %s, \"magic\": %s",
+					(i == 0 ? "" : ","), 'A' + i, (long long) st[i].offset,
+					json_bool(st[i].readable), json_bool(st[i].magic_ok));
+				if (st[i].magic_ok)
+					fprintf(fp, ", \"version\": %u, \"ext_sectors\": %u, \"header_crc\": %s, \"ext_crc\": %s, "
+						"\"hmac\": %s, \"valid\": %s, \"current\": %s, \"sernum\": %u, "
+						"\"failed_boots\": %u, \"flags\": %u, \"variables\": ",
+						st[i].version, st[i].ext_sectors,
+						json_bool(st[i].header_crc_ok), json_bool(st[i].ext_crc_ok),
+						json_bool(st[i].hmac_ok), json_bool(st[i].valid),
+						json_bool(st[i].current), st[i].sernum,
+						st[i].failed_boots, st[i].flags);
+				if (st[i].magic_ok && snap[i] != NULL)
+					fprintf(fp, "%d", bootinfo_snapshot_count(snap[i]));
+				else if (st[i].magic_ok)
+					fputs("null", fp);
+				else
+					fputs(", \"valid\": false, \"current\": false", fp);
+				fputs(" }", fp);
+			}
+			fputs("\n    ],\n    \"differences\": ", fp);
+			if (snap[0] != NULL && snap[1] != NULL) {
+				fputc('[', fp);
+				if (write_differences(fp, snap) > 0)
+					fputs("\n    ", fp);
+				fputc(']', fp);
+			} else
+				fputs("null", fp);
+		}
+		fputs("\n  }", fp);
+	} else {
+		for (i = 0; i < (error == NULL ? BOOTINFO_COPY_COUNT : 1); i++) {
+			csv_field(fp, img->path);
+			fputc(',', fp);
+			csv_field(fp, (error == NULL ? "" : error));
+			if (error != NULL) {
+				fputs(",,,,,,,,,,,,,,,,\n", fp);
+				break;
+			}
+			fprintf(fp, ",%c,%lld,%s,%s,", 'A' + i, (long long) st[i].offset,
+				csv_bool(st[i].readable), csv_bool(st[i].magic_ok));
+			if (st[i].magic_ok)
+				fprintf(fp, "%u,%u,%s,%s,%s,", st[i].version, st[i].ext_sectors,
+					csv_bool(st[i].header_crc_ok), csv_bool(st[i].ext_crc_ok),
+					csv_bool(st[i].hmac_ok));
+			else
+				fputs(",,,,,", fp);
+			fprintf(fp, "%s,%s,", csv_bool(st[i].valid), csv_bool(st[i].current));
+			if (st[i].magic_ok)
+				fprintf(fp, "%u,%u,%u,", st[i].sernum, st[i].failed_boots, st[i].flags);
+			else
+				fputs(",,,", fp);
+			if (snap[i] != NULL)
+				fprintf(fp, "%d", bootinfo_snapshot_count(snap[i]));
+			fprintf(fp, ",%s\n", diffs);
+		}
+	}
+	fclose(fp);
+
+	for (i = 0; i < BOOTINFO_COPY_COUNT; i++)
+		bootinfo_snapshot_put(snap[i]);
+	if (error == NULL)
+		bootinfo_close(ctx);
+
+} /* analyze_image */
+
+/*
+ * worker
+ */
+static void *
+worker (void *arg __attribute__((unused)))
+{
+	size_t i;
+
+	while ((i = atomic_fetch_add(&next_image, 1)) < image_count)
+		analyze_image(&images[i]);
+	return NULL;
+
+} /* worker */
+
+/*
+ * read_image_list
+ *
+ * Reads image names, one per line, from stdin.
+ */
+static int
+read_image_list (void)
+{
+	char *line = NULL;
+	size_t linesize = 0, alloc = 0;
+	ssize_t len;
+
+	while ((len = getline(&line, &linesize, stdin)) >= 0) {
+		if (len > 0 && line[len-1] == '\n')
+			line[--len] = '\0';
+		if (len == 0)
+			continue;
+		if (image_count >= alloc) {
+			struct image *newlist;
+			alloc = (alloc == 0 ? 64 : alloc * 2);
+			newlist = realloc(images, alloc * sizeof(*images));
+			if (newlist == NULL) {
+				free(line);
+				return -1;
+			}
+			images = newlist;
+		}
+		memset(&images[image_count], 0, sizeof(*images));
+		images[image_count].path = strdup(line);
+		if (images[image_count].path == NULL) {
+			free(line);
+			return -1;
+		}
+		image_count += 1;
+	}
+	free(line);
+	return 0;
+
+} /* read_image_list */
+
+/*
+ * main program
+ */
+int
+main (int argc, char * const argv[])
+{
+	int c, which, i;
+	long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	pthread_t *threads;
+	size_t n;
+
+	while ((c = getopt_long_only(argc, argv, shortopts, options, &which)) != -1) {
+
+		switch (c) {
+		case 'h':
+			print_usage();
+			return 0;
+		case 'S':
+			storename = optarg;
+			break;
+		case 'f':
+			if (strcmp(optarg, "json") == 0)
+				json_output = true;
+			else if (strcmp(optarg, "csv") == 0)
+				json_output = false;
+			else {
+				fprintf(stderr, "Error: unrecognized output format: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'j':
+			jobs = strtol(optarg, NULL, 10);
+			if (jobs < 1) {
+				fprintf(stderr, "Error: invalid job count: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 0:
+			if (strcmp(options[which].name, "version") == 0) {
+				printf("%s\n", VERSION);
+				return 0;
+			}
+			/* fallthrough */
+		default:
+			fprintf(stderr, "Error: unrecognized option\n");
+			print_usage();
+			return 1;
+		} /* switch (c) */
+
+	} /* while getopt */
+
+	if (optind < argc) {
+		image_count = argc - optind;
+		images = calloc(image_count, sizeof(*images));
+		if (images == NULL) {
+			perror("images");
+			return 1;
+		}
+		for (n = 0; n < image_count; n++)
+			images[n].path = argv[optind + n];
+	} else if (read_image_list() < 0) {
+		perror("reading image list");
+		return 1;
+	}
+
+	if ((size_t) jobs > image_count)
+		jobs = (image_count == 0 ? 1 : image_count);
+	threads = calloc(jobs, sizeof(*threads));
+	if (threads == NULL) {
+		perror("threads");
+		return 1;
+	}
+	atomic_init(&next_image, 0);
+	for (i = 0; i < jobs; i++) {
+		if (pthread_create(&threads[i], NULL, worker, NULL) != 0) {
+			jobs = i;
+			break;
+		}
+	}
+	/* no threads at all: do the work here */
+	if (jobs == 0)
+		worker(NULL);
+	for (i = 0; i < jobs; i++)
+		pthread_join(threads[i], NULL);
+
+	if (json_output)
+		printf("[\n");
+	else
+		printf("file,error,copy,offset,readable,magic,version,ext_sectors,header_crc,ext_crc,"
+		       "hmac,valid,current,sernum,failed_boots,flags,variables,differences\n");
+	for (n = 0; n < image_count; n++) {
+		if (images[n].report == NULL) {
+			fprintf(stderr, "%s: could not allocate report\n", images[n].path);
+			continue;
+		}
+		if (json_output && n > 0)
+			printf(",\n");
+		fwrite(images[n].report, 1, images[n].reportlen, stdout);
+	}
+	if (json_output)
+		printf("\n]\n");
+	return 0;
+
+} /* main */
@@ -0,0 +1,1097 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * imx-bootinfo-fuse.c
+ *
+ * FUSE daemon presenting a bootinfo variable store as a
+ * directory with one file per variable.  A file's contents
+ * are the variable's value followed by a newline.
+ *
+ * Reads are served from an in-memory snapshot of the store.
+ * Changes made through the mount are held in memory and
+ * written to the store in a single update every commit
+ * interval, on fsync(), and at unmount.  Writing an empty
+ * file deletes the variable.
+ *
+ * The store is locked only while it is being read or
+ * written, so other programs may still update it.  In
+ * intervals with nothing to commit, the store is re-read
+ * and the snapshot replaced if its contents changed, so
+ * their changes become visible within one interval.
+ *
+ * Copyright (c) 2022, Matthew Madison
+ */
+
+#define FUSE_USE_VERSION 31
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+#include <fuse.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <errno.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "bootinfo.h"
+
+#define DEFAULT_COMMIT_INTERVAL 5
+
+/*
+ * Changed variable, not yet committed.
+ * A NULL value means the variable was removed.
+ */
+struct pending_var {
+	struct pending_var *next;
+	char *name;
+	char *value;
+};
+
+/*
+ * Per-open state: the file contents as seen
+ * by the opener, staged when the file is flushed.
+ */
+struct open_var {
+	char *name;
+	char *buf;
+	size_t len;
+	size_t size;
+	bool dirty;
+};
+
+static struct bifs_options {
+	const char *storename;
+	unsigned int interval;
+	int show_help;
+	int show_version;
+} options = {
+	.interval = DEFAULT_COMMIT_INTERVAL,
+};
+
+#define OPTION(t_, p_) { t_, offsetof(struct bifs_options, p_), 1 }
+static const struct fuse_opt option_spec[] = {
+	OPTION("--store=%s", storename),
+	OPTION("-S %s", storename),
+	OPTION("--commit-interval=%u", interval),
+	OPTION("-i %u", interval),
+	OPTION("-h", show_help),
+	OPTION("--help", show_help),
+	OPTION("--version", show_version),
+	FUSE_OPT_END
+};
+
+/*
+ * The state lock protects everything here and is never
+ * held across store I/O.  The commit lock serializes
+ * commits and snapshot refreshes; it is taken before
+ * the state lock.  The committing list holds the changes
+ * being written, and is changed only with both held.
+ */
+static struct {
+	pthread_mutex_t lock;
+	pthread_mutex_t commit_lock;
+	pthread_cond_t wakeup;
+	pthread_t committer;
+	bool committer_running;
+	bool stopping;
+	bootinfo_snapshot_t *snap;
+	struct pending_var *pending;
+	struct pending_var *committing;
+	struct timespec mtime;
+	size_t maxvalue;
+} state = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.commit_lock = PTHREAD_MUTEX_INITIALIZER,
+	.wakeup = PTHREAD_COND_INITIALIZER,
+};
+
+/*
+ * print_usage
+ */
+static void
+print_usage (const char *progname)
+{
+	printf("\nUsage:\n");
+	printf("\t%s [options] MOUNTPOINT\n", progname);
+	printf("Options:\n");
+	printf(" --store=NAME	      	-S NAME	present the named variable store instead of the default store\n");
+	printf(" --commit-interval=SECS	-i SECS	seconds between commits of pending changes (default %u)\n",
+	       DEFAULT_COMMIT_INTERVAL);
+	printf(" --help		      	-h	display this help text\n");
+	printf(" --version	      	  	display version information\n");
+	printf("\n");
+
+} /* print_usage */
+
+/*
+ * touch_state
+ *
+ * Records a change in the presented contents.  Every file
+ * shares the same modification time, so that the kernel
+ * drops its cached pages for them after a change.
+ *
+ * Caller must hold the state lock.
+ */
+static void
+touch_state (void)
+{
+	clock_gettime(CLOCK_REALTIME, &state.mtime);
+
+} /* touch_state */
+
+/*
+ * var_name
+ *
+ * Maps a path to a variable name, returning
+ * NULL for the root directory or a path that
+ * cannot name a variable.
+ */
+static const char *
+var_name (const char *path)
+{
+	const char *cp;
+
+	if (*path != '/' || path[1] == '\0')
+		return NULL;
+	path += 1;
+	if (*path != '_' && !isalpha(*path))
+		return NULL;
+	for (cp = path + 1; *cp != '\0'; cp++)
+		if (!(*cp == '_' || isalnum(*cp)))
+			return NULL;
+	return path;
+
+} /* var_name */
+
+/*
+ * find_var
+ *
+ * Caller must hold the state lock.
+ */
+static struct pending_var *
+find_var (struct pending_var *list, const char *name)
+{
+	struct pending_var *p;
+
+	for (p = list; p != NULL; p = p->next)
+		if (strcmp(p->name, name) == 0)
+			return p;
+	return NULL;
+
+} /* find_var */
+
+/*
+ * find_pending
+ *
+ * Returns the latest uncommitted change to a
+ * variable, including one being committed.
+ *
+ * Caller must hold the state lock.
+ */
+static struct pending_var *
+find_pending (const char *name)
+{
+	struct pending_var *p = find_var(state.pending, name);
+
+	return (p == NULL ? find_var(state.committing, name) : p);
+
+} /* find_pending */
+
+/*
+ * lookup_var
+ *
+ * Returns the current value of a variable, taking
+ * uncommitted changes into account, or NULL if the
+ * variable does not exist.
+ *
+ * Caller must hold the state lock.
+ */
+static const char *
+lookup_var (const char *name)
+{
+	struct pending_var *p = find_pending(name);
+	const char *value;
+
+	if (p != NULL)
+		return p->value;
+	if (bootinfo_snapshot_var_get(state.snap, name, &value) < 0)
+		return NULL;
+	return value;
+
+} /* lookup_var */
+
+/*
+ * stage_var
+ *
+ * Records a change to a variable for the next commit.
+ * Takes ownership of value.
+ *
+ * Caller must hold the state lock.
+ */
+static int
+stage_var (const char *name, char *value)
+{
+	struct pending_var *p = find_var(state.pending, name);
+
+	if (p == NULL) {
+		p = calloc(1, sizeof(*p));
+		if (p == NULL)
+			return -ENOMEM;
+		p->name = strdup(name);
+		if (p->name == NULL) {
+			free(p);
+			return -ENOMEM;
+		}
+		p->next = state.pending;
+		state.pending = p;
+	} else
+		free(p->value);
+	p->value = value;
+	touch_state();
+	return 0;
+
+} /* stage_var */
+
+/*
+ * free_vars
+ *
+ * Caller must hold the state lock.
+ */
+static void
+free_vars (struct pending_var **list)
+{
+	struct pending_var *p;
+
+	while (*list != NULL) {
+		p = *list;
+		*list = p->next;
+		free(p->name);
+		free(p->value);
+		free(p);
+	}
+
+} /* free_vars */
+
+/*
+ * restore_committing
+ *
+ * Puts back changes from a failed commit, except
+ * for variables that were changed again meanwhile.
+ *
+ * Caller must hold the state lock.
+ */
+static void
+restore_committing (void)
+{
+	struct pending_var *p;
+
+	while (state.committing != NULL) {
+		p = state.committing;
+		state.committing = p->next;
+		if (find_var(state.pending, p->name) != NULL) {
+			free(p->name);
+			free(p->value);
+			free(p);
+		} else {
+			p->next = state.pending;
+			state.pending = p;
+		}
+	}
+
+} /* restore_committing */
+
+/*
+ * snapshot_equal
+ */
+static bool
+snapshot_equal (bootinfo_snapshot_t *a, bootinfo_snapshot_t *b)
+{
+	const char *aname, *avalue, *bname, *bvalue;
+	int i, count;
+
+	count = bootinfo_snapshot_count(a);
+	if (count != bootinfo_snapshot_count(b))
+		return false;
+	for (i = 0; i < count; i++) {
+		if (bootinfo_snapshot_var_at(a, i, &aname, &avalue) < 0 ||
+		    bootinfo_snapshot_var_at(b, i, &bname, &bvalue) < 0)
+			return false;
+		if (strcmp(aname, bname) != 0 || strcmp(avalue, bvalue) != 0)
+			return false;
+	}
+	return true;
+
+} /* snapshot_equal */
+
+/*
+ * publish_snapshot
+ *
+ * Replaces the snapshot, taking over the caller's
+ * reference, and touches the state if the contents
+ * changed.
+ *
+ * Caller must hold the state lock.
+ */
+static void
+publish_snapshot (bootinfo_snapshot_t *snap)
+{
+	bool changed = !snapshot_equal(state.snap, snap);
+
+	bootinfo_snapshot_put(state.snap);
+	state.snap = snap;
+	if (changed)
+		touch_state();
+
+} /* publish_snapshot */
+
+/*
+ * commit_pending
+ *
+ * Writes all pending changes to the store with a
+ * single update, then refreshes the snapshot.  The
+ * changes are moved to the committing list first, so
+ * the store is opened and written without the state
+ * lock held, while lookups still see them.  A variable
+ * the library rejects is reported and dropped; if the
+ * update itself fails, the changes are put back for
+ * the next attempt.
+ *
+ * Caller must hold the commit lock, but not the state lock.
+ */
+static int
+commit_pending (void)
+{
+	bootinfo_ctx_t *ctx;
+	bootinfo_snapshot_t *snap = NULL;
+	struct pending_var *p;
+	int ret = 0;
+
+	pthread_mutex_lock(&state.lock);
+	state.committing = state.pending;
+	state.pending = NULL;
+	pthread_mutex_unlock(&state.lock);
+	if (state.committing == NULL)
+		return 0;
+
+	if (bootinfo_open_store(&ctx, options.storename, 0) < 0) {
+		ret = -errno;
+		if (ctx != NULL)
+			bootinfo_close(ctx);
+		fprintf(stderr, "imx-bootinfo-fuse: opening store: %s\n", strerror(-ret));
+		goto depart;
+	}
+	for (p = state.committing; p != NULL; p = p->next) {
+		if (bootinfo_bootvar_set(ctx, p->name, p->value) < 0) {
+			/* deleting a variable that was never committed */
+			if (errno == ENOENT && (p->value == NULL || *p->value == '\0'))
+				continue;
+			fprintf(stderr, "imx-bootinfo-fuse: %s: %s\n", p->name, strerror(errno));
+		}
+	}
+	if (bootinfo_update(ctx) < 0) {
+		ret = -errno;
+		bootinfo_close(ctx);
+		fprintf(stderr, "imx-bootinfo-fuse: updating store: %s\n", strerror(-ret));
+		goto depart;
+	}
+	snap = bootinfo_snapshot_get(ctx);
+	bootinfo_close(ctx);
+
+  depart:
+	pthread_mutex_lock(&state.lock);
+	if (ret < 0)
+		restore_committing();
+	else {
+		free_vars(&state.committing);
+		if (snap != NULL)
+			publish_snapshot(snap);
+		touch_state();
+	}
+	pthread_mutex_unlock(&state.lock);
+	return ret;
+
+} /* commit_pending */
+
+/*
+ * refresh_snapshot
+ *
+ * Re-reads the store to pick up changes
+ * made by other programs.
+ *
+ * Caller must hold the commit lock, but not the state lock.
+ */
+static void
+refresh_snapshot (void)
+{
+	bootinfo_ctx_t *ctx;
+	bootinfo_snapshot_t *snap;
+
+	if (bootinfo_open_store(&ctx, options.storename, BOOTINFO_O_RDONLY) < 0) {
+		if (ctx != NULL)
+			bootinfo_close(ctx);
+		return;
+	}
+	snap = bootinfo_snapshot_get(ctx);
+	bootinfo_close(ctx);
+	if (snap == NULL)
+		return;
+	pthread_mutex_lock(&state.lock);
+	publish_snapshot(snap);
+	pthread_mutex_unlock(&state.lock);
+
+} /* refresh_snapshot */
+
+/*
+ * committer
+ *
+ * Thread that commits pending changes once per
+ * commit interval, or refreshes the snapshot
+ * if there are none.
+ */
+static void *
+committer (void *arg __attribute__((unused)))
+{
+	struct timespec deadline;
+	bool idle;
+
+	pthread_mutex_lock(&state.lock);
+	while (!state.stopping) {
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += options.interval;
+		while (!state.stopping &&
+		       pthread_cond_timedwait(&state.wakeup, &state.lock, &deadline) != ETIMEDOUT);
+		if (state.stopping)
+			break;
+		idle = (state.pending == NULL);
+		pthread_mutex_unlock(&state.lock);
+		pthread_mutex_lock(&state.commit_lock);
+		if (idle)
+			refresh_snapshot();
+		else
+			commit_pending();
+		pthread_mutex_unlock(&state.commit_lock);
+		pthread_mutex_lock(&state.lock);
+	}
+	pthread_mutex_unlock(&state.lock);
+	return NULL;
+
+} /* committer */
+
+/*
+ * content_alloc
+ *
+ * Makes sure an open file's buffer
+ * can hold at least len bytes.
+ */
+static int
+content_alloc (struct open_var *ov, size_t len)
+{
+	char *newbuf;
+	size_t newsize;
+
+	if (len <= ov->size)
+		return 0;
+	if (len > state.maxvalue + 1)
+		return -EFBIG;
+	for (newsize = (ov->size == 0 ? 64 : ov->size); newsize < len; newsize *= 2);
+	newbuf = realloc(ov->buf, newsize);
+	if (newbuf == NULL)
+		return -ENOMEM;
+	ov->buf = newbuf;
+	ov->size = newsize;
+	return 0;
+
+} /* content_alloc */
+
+/*
+ * content_resize
+ */
+static int
+content_resize (struct open_var *ov, size_t len)
+{
+	int ret = content_alloc(ov, len);
+
+	if (ret < 0)
+		return ret;
+	if (len > ov->len)
+		memset(ov->buf + ov->len, 0, len - ov->len);
+	ov->len = len;
+	return 0;
+
+} /* content_resize */
+
+/*
+ * stage_content
+ *
+ * Converts file contents back into a variable value
+ * and stages it.
+ *
+ * Caller must hold the state lock.
+ */
+static int
+stage_content (const char *name, const char *buf, size_t len)
+{
+	char *value;
+	size_t i;
+
+	if (len > 0 && buf[len-1] == '\n')
+		len -= 1;
+	for (i = 0; i < len; i++)
+		if (!isprint(buf[i]))
+			return -EINVAL;
+	value = strndup(buf, len);
+	if (value == NULL)
+		return -ENOMEM;
+	return stage_var(name, value);
+
+} /* stage_content */
+
+/*
+ * new_open_var
+ *
+ * Caller must hold the state lock.
+ */
+static struct open_var *
+new_open_var (const char *name, const char *value)
+{
+	struct open_var *ov = calloc(1, sizeof(*ov));
+	size_t len;
+
+	if (ov == NULL)
+		return NULL;
+	ov->name = strdup(name);
+	if (ov->name == NULL) {
+		free(ov);
+		return NULL;
+	}
+	if (value != NULL && *value != '\0') {
+		len = strlen(value);
+		ov->buf = malloc(len + 1);
+		if (ov->buf == NULL) {
+			free(ov->name);
+			free(ov);
+			return NULL;
+		}
+		memcpy(ov->buf, value, len);
+		ov->buf[len] = '\n';
+		ov->len = ov->size = len + 1;
+	}
+	return ov;
+
+} /* new_open_var */
+
+/*
+ * free_open_var
+ */
+static void
+free_open_var (struct open_var *ov)
+{
+	free(ov->name);
+	free(ov->buf);
+	free(ov);
+
+} /* free_open_var */
+
+/*
+ * fi_open_var
+ */
+static struct open_var *
+fi_open_var (struct fuse_file_info *fi)
+{
+	return (struct open_var *)(uintptr_t) fi->fh;
+
+} /* fi_open_var */
+
+/*
+ * fill_stat
+ *
+ * Caller must hold the state lock.
+ */
+static void
+fill_stat (struct stat *stbuf, const char *name, size_t size)
+{
+	memset(stbuf, 0, sizeof(*stbuf));
+	stbuf->st_uid = getuid();
+	stbuf->st_gid = getgid();
+	stbuf->st_atim = stbuf->st_mtim = stbuf->st_ctim = state.mtime;
+	if (name == NULL) {
+		stbuf->st_mode = S_IFDIR | 0755;
+		stbuf->st_nlink = 2;
+	} else {
+		/* underscore-prefixed variables are commonly key blobs */
+		stbuf->st_mode = S_IFREG | (*name == '_' ? 0600 : 0644);
+		stbuf->st_nlink = 1;
+		stbuf->st_size = size;
+	}
+
+} /* fill_stat */
+
+/*
+ * bifs_init
+ */
+static void *
+bifs_init (struct fuse_conn_info *conn __attribute__((unused)),
+	   struct fuse_config *cfg)
+{
+	/*
+	 * Let the kernel keep cached file contents
+	 * across opens until the mtime changes.
+	 */
+	cfg->auto_cache = 1;
+	pthread_mutex_lock(&state.lock);
+	if (pthread_create(&state.committer, NULL, committer, NULL) == 0)
+		state.committer_running = true;
+	else
+		fprintf(stderr, "imx-bootinfo-fuse: could not start commit thread\n");
+	pthread_mutex_unlock(&state.lock);
+	return NULL;
+
+} /* bifs_init */
+
+/*
+ * bifs_destroy
+ */
+static void
+bifs_destroy (void *private_data __attribute__((unused)))
+{
+	pthread_mutex_lock(&state.lock);
+	state.stopping = true;
+	pthread_cond_signal(&state.wakeup);
+	pthread_mutex_unlock(&state.lock);
+	if (state.committer_running)
+		pthread_join(state.committer, NULL);
+	pthread_mutex_lock(&state.commit_lock);
+	commit_pending();
+	pthread_mutex_unlock(&state.commit_lock);
+	pthread_mutex_lock(&state.lock);
+	free_vars(&state.pending);
+	bootinfo_snapshot_put(state.snap);
+	state.snap = NULL;
+	pthread_mutex_unlock(&state.lock);
+
+} /* bifs_destroy */
+
+/*
+ * bifs_getattr
+ */
+static int
+bifs_getattr (const char *path, struct stat *stbuf, struct fuse_file_info *fi)
+{
+	const char *name, *value;
+	int ret = 0;
+
+	if (strcmp(path, "/") == 0) {
+		pthread_mutex_lock(&state.lock);
+		fill_stat(stbuf, NULL, 0);
+		pthread_mutex_unlock(&state.lock);
+		return 0;
+	}
+	name = var_name(path);
+	if (name == NULL)
+		return -ENOENT;
+	pthread_mutex_lock(&state.lock);
+	if (fi != NULL && fi->fh != 0)
+		fill_stat(stbuf, name, fi_open_var(fi)->len);
+	else {
+		value = lookup_var(name);
+		if (value == NULL)
+			ret = -ENOENT;
+		else
+			fill_stat(stbuf, name, (*value == '\0' ? 0 : strlen(value) + 1));
+	}
+	pthread_mutex_unlock(&state.lock);
+	return ret;
+
+} /* bifs_getattr */
+
+/*
+ * bifs_readdir
+ */
+static int
+bifs_readdir (const char *path, void *buf, fuse_fill_dir_t filler,
+	      off_t offset __attribute__((unused)),
+	      struct fuse_file_info *fi __attribute__((unused)),
+	      enum fuse_readdir_flags flags __attribute__((unused)))
+{
+	struct pending_var *p;
+	const char *name, *value;
+	int i, count;
+
+	if (strcmp(path, "/") != 0)
+		return -ENOTDIR;
+	filler(buf, ".", NULL, 0, 0);
+	filler(buf, "..", NULL, 0, 0);
+	pthread_mutex_lock(&state.lock);
+	count = bootinfo_snapshot_count(state.snap);
+	for (i = 0; i < count; i++) {
+		if (bootinfo_snapshot_var_at(state.snap, i, &name, &value) < 0)
+			break;
+		p = find_pending(name);
+		if (p != NULL && p->value == NULL)
+			continue;
+		filler(buf, name, NULL, 0, 0);
+	}
+	for (p = state.pending; p != NULL; p = p->next)
+		if (p->value != NULL && bootinfo_snapshot_var_get(state.snap, p->name, &value) < 0)
+			filler(buf, p->name, NULL, 0, 0);
+	for (p = state.committing; p != NULL; p = p->next)
+		if (p->value != NULL && find_var(state.pending, p->name) == NULL &&
+		    bootinfo_snapshot_var_get(state.snap, p->name, &value) < 0)
+			filler(buf, p->name, NULL, 0, 0);
+	pthread_mutex_unlock(&state.lock);
+	return 0;
+
+} /* bifs_readdir */
+
+/*
+ * bifs_open
+ */
+static int
+bifs_open (const char *path, struct fuse_file_info *fi)
+{
+	const char *name = var_name(path);
+	const char *value;
+	struct open_var *ov;
+
+	if (name == NULL)
+		return -ENOENT;
+	pthread_mutex_lock(&state.lock);
+	value = lookup_var(name);
+	if (value == NULL) {
+		pthread_mutex_unlock(&state.lock);
+		return -ENOENT;
+	}
+	ov = new_open_var(name, (fi->flags & O_TRUNC) ? NULL : value);
+	if (ov != NULL && (fi->flags & O_TRUNC) && *value != '\0')
+		ov->dirty = true;
+	pthread_mutex_unlock(&state.lock);
+	if (ov == NULL)
+		return -ENOMEM;
+	fi->fh = (uintptr_t) ov;
+	return 0;
+
+} /* bifs_open */
+
+/*
+ * bifs_create
+ */
+static int
+bifs_create (const char *path, mode_t mode __attribute__((unused)),
+	     struct fuse_file_info *fi)
+{
+	const char *name = var_name(path);
+	struct open_var *ov;
+	int ret = 0;
+
+	if (name == NULL)
+		return -EINVAL;
+	pthread_mutex_lock(&state.lock);
+	ov = new_open_var(name, NULL);
+	if (ov == NULL)
+		ret = -ENOMEM;
+	else if (lookup_var(name) == NULL) {
+		char *empty = strdup("");
+		ret = (empty == NULL ? -ENOMEM : stage_var(name, empty));
+		if (ret < 0)
+			free_open_var(ov);
+	} else
+		/* O_CREAT on an existing variable without O_EXCL */
+		ov->dirty = true;
+	pthread_mutex_unlock(&state.lock);
+	if (ret == 0)
+		fi->fh = (uintptr_t) ov;
+	return ret;
+
+} /* bifs_create */
+
+/*
+ * bifs_read
+ */
+static int
+bifs_read (const char *path __attribute__((unused)), char *buf, size_t size,
+	   off_t offset, struct fuse_file_info *fi)
+{
+	struct open_var *ov = fi_open_var(fi);
+
+	if ((size_t) offset >= ov->len)
+		return 0;
+	if (size > ov->len - offset)
+		size = ov->len - offset;
+	memcpy(buf, ov->buf + offset, size);
+	return size;
+
+} /* bifs_read */
+
+/*
+ * bifs_write
+ */
+static int
+bifs_write (const char *path __attribute__((unused)), const char *buf, size_t size,
+	    off_t offset, struct fuse_file_info *fi)
+{
+	struct open_var *ov = fi_open_var(fi);
+	int ret;
+
+	if (offset + size > ov->len) {
+		ret = content_resize(ov, offset + size);
+		if (ret < 0)
+			return ret;
+	}
+	memcpy(ov->buf + offset, buf, size);
+	ov->dirty = true;
+	return size;
+
+} /* bifs_write */
+
+/*
+ * bifs_truncate
+ */
+static int
+bifs_truncate (const char *path, off_t size, struct fuse_file_info *fi)
+{
+	const char *name = var_name(path);
+	const char *value;
+	struct open_var *ov;
+	int ret;
+
+	if (name == NULL)
+		return -ENOENT;
+	if (fi != NULL && fi->fh != 0) {
+		ov = fi_open_var(fi);
+		ret = content_resize(ov, size);
+		if (ret == 0)
+			ov->dirty = true;
+		return ret;
+	}
+	pthread_mutex_lock(&state.lock);
+	value = lookup_var(name);
+	if (value == NULL)
+		ret = -ENOENT;
+	else {
+		ov = new_open_var(name, value);
+		if (ov == NULL)
+			ret = -ENOMEM;
+		else {
+			ret = content_resize(ov, size);
+			if (ret == 0)
+				ret = stage_content(name, ov->buf, ov->len);
+			free_open_var(ov);
+		}
+	}
+	pthread_mutex_unlock(&state.lock);
+	return ret;
+
+} /* bifs_truncate */
+
+/*
+ * bifs_flush
+ *
+ * Stages the file's contents on close, so a
+ * bad value is reported back to the writer.
+ */
+static int
+bifs_flush (const char *path __attribute__((unused)), struct fuse_file_info *fi)
+{
+	struct open_var *ov = fi_open_var(fi);
+	int ret = 0;
+
+	if (!ov->dirty)
+		return 0;
+	pthread_mutex_lock(&state.lock);
+	ret = stage_content(ov->name, ov->buf, ov->len);
+	pthread_mutex_unlock(&state.lock);
+	if (ret == 0)
+		ov->dirty = false;
+	return ret;
+
+} /* bifs_flush */
+
+/*
+ * bifs_release
+ */
+static int
+bifs_release (const char *path __attribute__((unused)), struct fuse_file_info *fi)
+{
+	free_open_var(fi_open_var(fi));
+	return 0;
+
+} /* bifs_release */
+
+/*
+ * bifs_fsync
+ *
+ * Commits all pending changes immediately.
+ */
+static int
+bifs_fsync (const char *path, int datasync __attribute__((unused)),
+	    struct fuse_file_info *fi)
+{
+	int ret;
+
+	ret = bifs_flush(path, fi);
+	if (ret < 0)
+		return ret;
+	pthread_mutex_lock(&state.commit_lock);
+	ret = commit_pending();
+	pthread_mutex_unlock(&state.commit_lock);
+	return ret;
+
+} /* bifs_fsync */
+
+/*
+ * bifs_unlink
+ */
+static int
+bifs_unlink (const char *path)
+{
+	const char *name = var_name(path);
+	int ret;
+
+	if (name == NULL)
+		return -ENOENT;
+	pthread_mutex_lock(&state.lock);
+	ret = (lookup_var(name) == NULL ? -ENOENT : stage_var(name, NULL));
+	pthread_mutex_unlock(&state.lock);
+	return ret;
+
+} /* bifs_unlink */
+
+/*
+ * bifs_rename
+ */
+static int
+bifs_rename (const char *from, const char *to, unsigned int flags)
+{
+	const char *fromname = var_name(from);
+	const char *toname = var_name(to);
+	const char *value;
+	char *newvalue;
+	int ret;
+
+	if (fromname == NULL)
+		return -ENOENT;
+	if (toname == NULL)
+		return -EINVAL;
+	if (flags & ~RENAME_NOREPLACE)
+		return -EINVAL;
+	pthread_mutex_lock(&state.lock);
+	value = lookup_var(fromname);
+	if (value == NULL)
+		ret = -ENOENT;
+	else if ((flags & RENAME_NOREPLACE) && lookup_var(toname) != NULL)
+		ret = -EEXIST;
+	else if (strcmp(fromname, toname) == 0)
+		ret = 0;
+	else {
+		newvalue = strdup(value);
+		if (newvalue == NULL)
+			ret = -ENOMEM;
+		else {
+			ret = stage_var(toname, newvalue);
+			if (ret == 0)
+				ret = stage_var(fromname, NULL);
+		}
+	}
+	pthread_mutex_unlock(&state.lock);
+	return ret;
+
+} /* bifs_rename */
+
+/*
+ * bifs_utimens
+ *
+ * Timestamps are not stored; accepted
+ * so that touch(1) works.
+ */
+static int
+bifs_utimens (const char *path, const struct timespec tv[2] __attribute__((unused)),
+	      struct fuse_file_info *fi __attribute__((unused)))
+{
+	const char *name = var_name(path);
+	int ret = 0;
+
+	if (name == NULL)
+		return (strcmp(path, "/") == 0 ? 0 : -ENOENT);
+	pthread_mutex_lock(&state.lock);
+	if (lookup_var(name) == NULL)
+		ret = -ENOENT;
+	pthread_mutex_unlock(&state.lock);
+	return ret;
+
+} /* bifs_utimens */
+
+static const struct fuse_operations bifs_ops = {
+	.init		= bifs_init,
+	.destroy	= bifs_destroy,
+	.getattr	= bifs_getattr,
+	.readdir	= bifs_readdir,
+	.open		= bifs_open,
+	.create		= bifs_create,
+	.read		= bifs_read,
+	.write		= bifs_write,
+	.truncate	= bifs_truncate,
+	.flush		= bifs_flush,
+	.release	= bifs_release,
+	.fsync		= bifs_fsync,
+	.unlink		= bifs_unlink,
+	.rename		= bifs_rename,
+	.utimens	= bifs_utimens,
+};
+
+/*
+ * main program
+ */
+int
+main (int argc, char *argv[])
+{
+	struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+	bootinfo_ctx_t *ctx;
+	int ret, sectors;
+
+	if (fuse_opt_parse(&args, &options, option_spec, NULL) < 0)
+		return 1;
+
+	if (options.show_version) {
+		printf("%s\n", VERSION);
+		return 0;
+	}
+	if (options.show_help) {
+		print_usage(argv[0]);
+		fuse_opt_add_arg(&args, "--help");
+		args.argv[0][0] = '\0';
+		return fuse_main(args.argc, args.argv, &bifs_ops, NULL);
+	}
+	if (options.interval == 0) {
+		fprintf(stderr, "Error: commit interval must be at least one second\n");
+		return 1;
+	}
+
+	if (bootinfo_open_store(&ctx, options.storename, BOOTINFO_O_RDONLY) < 0) {
+		perror("bootinfo_open_store");
+		if (ctx != NULL)
+			bootinfo_close(ctx);
+		return 1;
+	}
+	state.snap = bootinfo_snapshot_get(ctx);
+	sectors = bootinfo_extension_sectors(ctx);
+	bootinfo_close(ctx);
+	if (state.snap == NULL || sectors < 0) {
+		perror("reading variable store");
+		return 1;
+	}
+	/* upper bound only; the library does the exact check at commit */
+	state.maxvalue = (size_t) sectors * 512;
+	touch_state();
+
+	/* have the kernel enforce the file modes */
+	fuse_opt_add_arg(&args, "-odefault_permissions");
+	ret = fuse_main(args.argc, args.argv, &bifs_ops, NULL);
+	fuse_opt_free_args(&args);
+	return ret;
+
+} /* main */
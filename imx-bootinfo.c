@@ -43,6 +43,8 @@
 
 #define MAX_BOOT_FAILURES 3
 
+static const char *storename = NULL;
+
 static struct option options[] = {
 	{ "boot-success",	no_argument,		0, 'b' },
 	{ "check-status",	no_argument,		0, 'c' },
@@ -51,13 +53,15 @@ static struct option options[] = {
 	{ "omit-name",		no_argument,		0, 'n' },
 	{ "from-file",		required_argument,	0, 'f' },
 	{ "force-initialize",	no_argument,		0, 'F' },
+	{ "authenticate",	no_argument,		0, 'A' },
 	{ "get-variable",	no_argument,		0, 'v' },
 	{ "set-variable",	no_argument,		0, 'V' },
+	{ "store",		required_argument,	0, 'S' },
 	{ "help",		no_argument,		0, 'h' },
 	{ "version",		no_argument,		0, 0   },
 	{ 0,			0,			0, 0   }
 };
-static const char *shortopts = ":bcIsnf:FvVh";
+static const char *shortopts = ":bcIsnf:FAvVS:h";
 
 static char *optarghelp[] = {
 	"--boot-success	      ",
@@ -67,8 +71,10 @@ static char *optarghelp[] = {
 	"--omit-name	      ",
 	"--from-file FILE     ",
 	"--force-initialize   ",
+	"--authenticate	      ",
 	"--get-variable	      ",
 	"--set-variable	      ",
+	"--store NAME	      ",
 	"--help		      ",
 	"--version	      ",
 };
@@ -81,8 +87,10 @@ static char *opthelp[] = {
 	"omit variable name in output (for use with --get-variable)",
 	"take variable value from FILE (for use with --set-variable)",
 	"force initialization even if bootinfo already initialized (for use with --initialize)",
+	"adopt a store written without authentication, adding HMACs (for use with --initialize)",
 	"get the value of a stored variable by name, list all if no name specified",
 	"set the value of a stored variable (delete if no value)",
+	"operate on the named variable store instead of the default store",
 	"display this help text",
 	"display version information"
 };
@@ -108,12 +116,17 @@ print_usage (void)
 } /* print_usage */
 
 static int
-boot_devinfo_init(int force_init)
+boot_devinfo_init(int force_init, int authenticate)
 {
 	bootinfo_ctx_t *ctx;
-
-	if (bootinfo_open(&ctx, force_init ? BOOTINFO_O_FORCE_INIT : 0) < 0) {
-		perror("bootinfo_open");
+	unsigned int flags = 0;
+
+	if (force_init)
+		flags |= BOOTINFO_O_FORCE_INIT;
+	if (authenticate)
+		flags |= BOOTINFO_O_AUTHENTICATE;
+	if (bootinfo_open_store(&ctx, storename, flags) < 0) {
+		perror("bootinfo_open_store");
 		return 1;
 	}
 	bootinfo_close(ctx);
@@ -127,8 +140,8 @@ boot_successful(void)
 	bootinfo_ctx_t *ctx;
 	unsigned int failed_boots;
 
-	if (bootinfo_open(&ctx, 0) < 0) {
-		perror("bootinfo_open");
+	if (bootinfo_open_store(&ctx, storename, 0) < 0) {
+		perror("bootinfo_open_store");
 		return 1;
 	}
 	if (bootinfo_mark_successful(ctx, &failed_boots) < 0) {
@@ -149,8 +162,8 @@ boot_check_status(void)
 	unsigned int failed_boots;
 	int rc = 0;
 
-	if (bootinfo_open(&ctx, 0) < 0) {
-		perror("bootinfo_open");
+	if (bootinfo_open_store(&ctx, storename, 0) < 0) {
+		perror("bootinfo_open_store");
 		return 1;
 	}
 	if (bootinfo_mark_in_progress(ctx, &failed_boots) < 0) {
@@ -178,15 +191,17 @@ show_bootinfo(void) {
 	bootinfo_ctx_t *ctx;
 	int sectors;
 
-	if (bootinfo_open(&ctx, BOOTINFO_O_RDONLY) < 0) {
-		perror("bootinfo_open");
+	if (bootinfo_open_store(&ctx, storename, BOOTINFO_O_RDONLY) < 0) {
+		perror("bootinfo_open_store");
 		return 1;
 	}
 	sectors = bootinfo_extension_sectors(ctx);
-	printf("devinfo version:	%d\n"
+	printf("Store:			%s\n"
+	       "devinfo version:	%d\n"
 	       "Boot in progress:	%s\n"
 	       "Failed boots:		%d\n"
 	       "Extension space:	%d sector%s\n",
+	       bootinfo_store_name(ctx),
 	       bootinfo_devinfo_version(ctx),
 	       bootinfo_is_in_progress(ctx) ? "YES" : "NO",
 	       bootinfo_failed_boot_count(ctx),
@@ -211,8 +226,8 @@ show_bootvar (const char *name, int omitname)
 	int ret;
 	int found = (name == NULL) ? 1 : 0;
 
-	if (bootinfo_open(&ctx, BOOTINFO_O_RDONLY) < 0) {
-		perror("bootinfo_open");
+	if (bootinfo_open_store(&ctx, storename, BOOTINFO_O_RDONLY) < 0) {
+		perror("bootinfo_open_store");
 		return 1;
 	}
 	for (ret = bootinfo_bootvar_iterate(ctx, &iterctx, &vname, &value);
@@ -309,8 +324,8 @@ set_bootvar (const char *name, const char *value, char *inputfile)
 			value = cp + 1;
 		}
 	}
-	if (bootinfo_open(&ctx, 0) < 0) {
-		perror("bootinfo_open");
+	if (bootinfo_open_store(&ctx, storename, 0) < 0) {
+		perror("bootinfo_open_store");
 		return 1;
 	}
 	if (bootinfo_bootvar_set(ctx, name, value) < 0) {
@@ -336,6 +351,7 @@ main (int argc, char * const argv[])
 	int c, which;
 	int omitname = 0;
 	int force_init = 0;
+	int authenticate = 0;
 	char *inputfile = NULL;
 	enum {
 		nocmd,
@@ -380,6 +396,9 @@ main (int argc, char * const argv[])
 		case 'F':
 			force_init = 1;
 			break;
+		case 'A':
+			authenticate = 1;
+			break;
 		case 'v':
 		case 'V':
 			if (cmd != nocmd) {
@@ -389,6 +408,9 @@ main (int argc, char * const argv[])
 			}
 			cmd = (c == 'v' ? showvar : setvar);
 			break;
+		case 'S':
+			storename = optarg;
+			break;
 		case 0:
 			if (strcmp(options[which].name, "version") == 0) {
 				printf("%s\n", VERSION);
@@ -411,7 +433,7 @@ main (int argc, char * const argv[])
 	case show:
 		return show_bootinfo();
 	case init:
-		return boot_devinfo_init(force_init);
+		return boot_devinfo_init(force_init, authenticate);
 	case showvar:
 		if (optind >= argc)
 			return show_bootvar(NULL, 0);
@@ -13,6 +13,7 @@
 #include <stdbool.h>
 #include <getopt.h>
 #include <string.h>
+#include <ctype.h>
 #include <libgen.h>
 #include <limits.h>
 #include <sys/types.h>
@@ -22,16 +23,23 @@
 #include "otp_bootcfg.h"
 #include "otp_srk.h"
 #include "otp_lock.h"
+#include "otp_plan.h"
+#include "otp_macaddr.h"
+#include "otp_field.h"
 
 static uint32_t desired_srk_hash[8];
 static bool     have_srk_hash = false;
 static uint32_t null_hash[8] = { 0 };
 static char *progname;
 static bool opt_quiet = false;
+static bool opt_dry_run = false;
 
 typedef int (*option_routine_t)(otpctx_t ctx, int argc, char * const argv[]);
 static int do_check_secure(otpctx_t ctx, int argc, char * const argv[]);
 static int do_secure(otpctx_t ctx, int argc, char * const argv[]);
+static int do_provision(otpctx_t ctx, int argc, char * const argv[]);
+static int do_get_field(otpctx_t ctx, int argc, char * const argv[]);
+static int do_set_field(otpctx_t ctx, int argc, char * const argv[]);
 static int do_show(otpctx_t ctx, int argc, char * const argv[]);
 
 static struct {
@@ -41,30 +49,42 @@ static struct {
 } commands[] = {
         { "is-secured", do_check_secure, "check fuses are set for secure boot" },
         { "secure",     do_secure,       "program fuses for secure boot" },
+        { "provision",  do_provision,    "program fuses from a manifest file" },
+        { "get-field",  do_get_field,    "show fuse fields (all, or those named)" },
+        { "set-field",  do_set_field,    "program fuse fields, given as NAME=VALUE" },
         { "show",       do_show,         "show fuses" },
 };
 
 static struct option options[] = {
 	{ "device",		required_argument,	0, 'd' },
 	{ "fuse-file",		required_argument,	0, 'f' },
+	{ "dry-run",		no_argument,		0, 'n' },
 	{ "help",		no_argument,		0, 'h' },
 	{ "quiet",		no_argument,		0, 'q' },
+	{ "simulate",		required_argument,	0, 's' },
+	{ "program-latency",	required_argument,	0, 'L' },
 	{ 0,			0,			0, 0   }
 };
-static const char *shortopts = ":d:f:chq";
+static const char *shortopts = ":d:f:chnqs:L:";
 
 static char *optarghelp[] = {
 	"--device             ",
 	"--fuse-file          ",
+	"--dry-run            ",
 	"--help               ",
 	"--quiet              ",
+	"--simulate           ",
+	"--program-latency    ",
 };
 
 static char *opthelp[] = {
 	"path to the OCOTP nvmem device",
 	"path to the SRK_1_2_3_4_fuse.bin file",
+	"show the fuses that would be programmed, without programming them",
 	"display this help text",
 	"omit prompts and information displays",
+	"path to a fuse map image, for a simulated fuse box",
+	"time to program each simulated fuse word, in microseconds",
 };
 
 
@@ -89,6 +109,34 @@ print_usage (void)
 } /* print_usage */
 
 
+/*
+ * read_fuse_file
+ *
+ * Reads the SRK hash from an SRK_1_2_3_4_fuse.bin file.
+ */
+static int
+read_fuse_file (const char *path, uint32_t srk_hash[SRK_FUSE_COUNT])
+{
+	int fd = open(path, O_RDONLY);
+	ssize_t n;
+
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	n = read(fd, srk_hash, SRK_FUSE_COUNT * sizeof(uint32_t));
+	close(fd);
+	if (n != (ssize_t) (SRK_FUSE_COUNT * sizeof(uint32_t))) {
+		if (n < 0)
+			perror(path);
+		else
+			fprintf(stderr, "%s: file too short\n", path);
+		return -1;
+	}
+	return 0;
+
+} /* read_fuse_file */
+
 /*
  * do_show
  *
@@ -146,6 +194,7 @@ do_show (otpctx_t ctx, int argc, char * const argv[])
 		return 1;
 	}
 
+	printf("%-32.32s %s\n", "SoC:", otp_context_soc_id(ctx));
 	printf("%-32.32s ", "SRK hashes:");
 	if (memcmp(srk_hash, null_hash, sizeof(srk_hash)) == 0)
 		printf("not set, %s\n", lstate_label[lstate]);
@@ -184,12 +233,53 @@ do_show (otpctx_t ctx, int argc, char * const argv[])
 } /* do_show */
 
 
+/*
+ * apply_plan
+ *
+ * Shows the fuse words a plan will program, then
+ * (unless this is a dry run) applies it.
+ */
+static int
+apply_plan (otpctx_t ctx, otp_plan_t *plan)
+{
+	otp_fuseword_id_t id;
+	int i;
+
+	if (otp_plan_change_count(plan) == 0) {
+		if (!opt_quiet || opt_dry_run)
+			printf("No fuses need programming.\n");
+		return 0;
+	}
+	if (!opt_quiet || opt_dry_run) {
+		printf("%s:\n", (opt_dry_run ? "Fuses that would be programmed" : "Programming fuses"));
+		// In the order they are programmed, with the locks last
+		for (i = 1; i <= OTP_FUSEWORD_COUNT; i++) {
+			id = (otp_fuseword_id_t) (i % OTP_FUSEWORD_COUNT);
+			if (otp_plan_changed(plan, id))
+				printf("    %-16.16s 0x%08x -> 0x%08x\n", otp_fuseword_name(id),
+				       plan->current[id], plan->desired[id]);
+		}
+	}
+	if (opt_dry_run)
+		return 0;
+	fflush(stdout);
+	if (otp_plan_apply(ctx, plan) < 0) {
+		perror("otp_plan_apply");
+		return 1;
+	}
+	if (!opt_quiet)
+		printf("Fuses programmed.\n");
+	return 0;
+
+} /* apply_plan */
+
 /*
  * do_secure
  */
 static int
 do_secure (otpctx_t ctx, int argc, char * const argv[])
 {
+	otp_plan_t plan;
 	uint32_t srk_hash[SRK_FUSE_COUNT];
 	uint32_t bootcfg[OTP_BOOTCFG_WORD_COUNT];
 	uint32_t locks;
@@ -201,10 +291,12 @@ do_secure (otpctx_t ctx, int argc, char * const argv[])
 		fprintf(stderr, "ERR: securing device requires fuse file\n");
 		return 1;
 	}
-	if (otp_srk_read(ctx, srk_hash, SRK_FUSE_COUNT) < 0) {
-		perror("otp_srk_read");
+	if (otp_plan_init(ctx, &plan) < 0) {
+		perror("otp_plan_init");
 		return 1;
 	}
+	for (i = 0; i < SRK_FUSE_COUNT; i++)
+		otp_plan_get(&plan, OCOTP_SRK0 + i, &srk_hash[i]);
 	if (memcmp(srk_hash, desired_srk_hash, sizeof(srk_hash)) == 0) {
 		if (!opt_quiet)
 			printf("SRK fuses already programmed correctly.\n");
@@ -216,19 +308,11 @@ do_secure (otpctx_t ctx, int argc, char * const argv[])
 			fprintf(stderr, "ERR: SRK fuses already programmed with different hashes\n");
 			return 1;
 		}
-		if (!opt_quiet)
-			printf("Programming SRK fuses.\n");
-		if (otp_srk_write(ctx, desired_srk_hash, SRK_FUSE_COUNT) < 0) {
-			perror("otp_srk_write");
-			return 1;
-		}
-		if (!opt_quiet)
-			printf("Programmed SRK fuses.\n");
-	}
-	if (otp_locks_read(ctx, &locks) < 0) {
-		perror("otp_locks_read");
-		return 1;
+		for (i = 0; i < SRK_FUSE_COUNT; i++)
+			otp_plan_set(&plan, OCOTP_SRK0 + i, desired_srk_hash[i]);
 	}
+
+	otp_plan_get(&plan, OCOTP_LOCK, &locks);
 	if (otp_lockstate_get(locks, OTP_LOCK_SRK, &lstate) < 0) {
 		perror("otp_lockstate_get");
 		return 1;
@@ -237,27 +321,18 @@ do_secure (otpctx_t ctx, int argc, char * const argv[])
 		if (!opt_quiet)
 			printf("SRK fuses already locked.\n");
 	} else if (lstate == OTP_LOCKSTATE_UNLOCKED) {
-		if (!opt_quiet)
-			printf("Locking SRK fuses.\n");
-		if (otp_lockstate_set(OTP_LOCK_SRK, OTP_LOCKSTATE_LOCKED, &locks) < 0) {
+		if (otp_lockstate_set(OTP_LOCK_SRK, OTP_LOCKSTATE_LOCKED, &locks) < 0 ||
+		    otp_plan_set(&plan, OCOTP_LOCK, locks) < 0) {
 			perror("otp_lockstate_set");
 			return 1;
 		}
-		if (otp_locks_update(ctx, locks) < 0) {
-			perror("otp_locks_update");
-			return 1;
-		}
-		if (!opt_quiet)
-			printf("Locked SRK fuses.\n");
 	} else {
 		fprintf(stderr, "ERR: unknown SRK lockstate: %u\n", lstate);
 		return 1;
 	}
 
-	if (otp_bootcfg_read(ctx, bootcfg, OTP_BOOTCFG_WORD_COUNT) < 0) {
-		perror("otp_bootcfg_read");
-		return 1;
-	}
+	for (i = 0; i < OTP_BOOTCFG_WORD_COUNT; i++)
+		otp_plan_get(&plan, OCOTP_BOOT_CFG0 + i, &bootcfg[i]);
 	if (otp_bootcfg_bool_get(bootcfg, OTP_BOOTCFG_WORD_COUNT,
 				 OTP_BOOT_CFG_SEC_CONFIG, &val) < 0) {
 		perror("otp_bootcfg_bool_get");
@@ -267,24 +342,400 @@ do_secure (otpctx_t ctx, int argc, char * const argv[])
 		if (!opt_quiet)
 			printf("SEC_CONFIG fuse already programmed.\n");
 	} else {
-		if (!opt_quiet)
-			printf("Programming SEC_CONFIG fuse.\n");
 		if (otp_bootcfg_bool_set(bootcfg, OTP_BOOTCFG_WORD_COUNT,
 					 OTP_BOOT_CFG_SEC_CONFIG, true) < 0) {
 			perror("otp_bootcfg_bool_set");
 			return 1;
 		}
-		if (otp_bootcfg_update(ctx, bootcfg, OTP_BOOTCFG_WORD_COUNT) < 0) {
-			perror("otp_bootcfg_update");
-			return 1;
+		for (i = 0; i < OTP_BOOTCFG_WORD_COUNT; i++)
+			otp_plan_set(&plan, OCOTP_BOOT_CFG0 + i, bootcfg[i]);
+	}
+
+	return apply_plan(ctx, &plan);
+
+} /* do_secure */
+
+/*
+ * Boolean BOOT_CFG fuses and general-purpose fuse
+ * words that can be set in a provisioning manifest.
+ */
+static const struct {
+	const char *name;
+	otp_boot_cfg_id_t id;
+} manifest_bootcfg_bools[] = {
+	{ "sec-config",		OTP_BOOT_CFG_SEC_CONFIG },
+	{ "sjc-disable",	OTP_BOOT_CFG_SJC_DISABLE },
+	{ "dir-bt-dis",		OTP_BOOT_CFG_DIR_BT_DIS },
+	{ "bt-fuse-sel",	OTP_BOOT_CFG_BT_FUSE_SEL },
+	{ "tzasc-enable",	OTP_BOOT_CFG_TZASC_ENABLE },
+};
+static const struct {
+	const char *name;
+	otp_fuseword_id_t id;
+} manifest_fusewords[] = {
+	{ "gp10",	OCOTP_GP10 },
+	{ "gp11",	OCOTP_GP11 },
+	{ "gp20",	OCOTP_GP20 },
+	{ "gp21",	OCOTP_GP21 },
+};
+
+/*
+ * parse_bool
+ */
+static int
+parse_bool (const char *str, bool *value)
+{
+	if (strcasecmp(str, "yes") == 0 || strcasecmp(str, "true") == 0 || strcmp(str, "1") == 0)
+		*value = true;
+	else if (strcasecmp(str, "no") == 0 || strcasecmp(str, "false") == 0 || strcmp(str, "0") == 0)
+		*value = false;
+	else
+		return -1;
+	return 0;
+
+} /* parse_bool */
+
+/*
+ * parse_u32
+ *
+ * Parses a number, which must take up the
+ * whole string.
+ */
+static int
+parse_u32 (const char *str, uint32_t *value)
+{
+	unsigned long val;
+	char *anchor;
+
+	errno = 0;
+	val = strtoul(str, &anchor, 0);
+	if (errno != 0 || anchor == str || *anchor != '\0' || val > UINT32_MAX)
+		return -1;
+	*value = (uint32_t) val;
+	return 0;
+
+} /* parse_u32 */
+
+/*
+ * parse_lock
+ *
+ * Parses a lock setting, NAME[:STATE], where STATE is one
+ * of locked (the default), write-protect or override-protect,
+ * into the desired locks word.
+ */
+static int
+parse_lock (char *str, uint32_t *locks)
+{
+	char *state = strchr(str, ':');
+	otp_lock_id_t id;
+	otp_lockstate_t lstate = OTP_LOCKSTATE_LOCKED;
+
+	if (state != NULL)
+		*state++ = '\0';
+	for (id = 0; id < OTP_LOCK_COUNT; id++)
+		if (strcasecmp(str, otp_lock_name(id)) == 0)
+			break;
+	if (id >= OTP_LOCK_COUNT)
+		return -1;
+	if (state == NULL || strcmp(state, "locked") == 0) {
+		// "locked" means both protections for 2-bit locks
+		if (otp_lockstate_set(id, OTP_LOCKSTATE_LOCKED, locks) == 0)
+			return 0;
+		lstate = OTP_LOCKSTATE_OW_PROTECT;
+	} else if (strcmp(state, "write-protect") == 0)
+		lstate = OTP_LOCKSTATE_W_PROTECT;
+	else if (strcmp(state, "override-protect") == 0)
+		lstate = OTP_LOCKSTATE_O_PROTECT;
+	else
+		return -1;
+	return otp_lockstate_set(id, lstate, locks);
+
+} /* parse_lock */
+
+/*
+ * trim
+ *
+ * Strips leading and trailing whitespace.
+ */
+static char *
+trim (char *str)
+{
+	char *end;
+
+	while (isspace((unsigned char) *str))
+		str++;
+	for (end = str + strlen(str); end > str && isspace((unsigned char) *(end-1)); end--);
+	*end = '\0';
+	return str;
+
+} /* trim */
+
+/*
+ * do_provision
+ *
+ * Programs fuses as described in a manifest file, with
+ * lines of the form "setting = value" ('#' starts a comment):
+ *
+ *   srk-hash = W0 W1 ... W7      SRK hash fuse words
+ *   srk-fuse-file = PATH         SRK hash, from SRK_1_2_3_4_fuse.bin
+ *   mac-address = XX:XX:XX:XX:XX:XX
+ *   gp10 (gp11, gp20, gp21) = VALUE
+ *   watchdog = yes | TIMEOUT     enable watchdog, optionally with timeout
+ *   sec-config (sjc-disable, dir-bt-dis, bt-fuse-sel, tzasc-enable) = yes
+ *   lock = NAME[:locked|write-protect|override-protect]
+ *   field NAME = VALUE           any field in the OTP_FIELDS table
+ *
+ * The whole manifest is checked against the current fuse
+ * settings before anything is programmed, and all of the
+ * changes are then applied as a single plan.
+ */
+static int
+do_provision (otpctx_t ctx, int argc, char * const argv[])
+{
+	otp_plan_t plan;
+	uint32_t srk_hash[SRK_FUSE_COUNT];
+	uint32_t words[OTP_FUSEWORD_COUNT], value;
+	uint32_t *bootcfg = &words[OCOTP_BOOT_CFG0];
+	otp_field_id_t field;
+	otp_fuseword_id_t id;
+	uint8_t macaddr[6];
+	bool have_srk = false, have_mac = false, enable;
+	char *line = NULL, *key, *val, *cp;
+	size_t linesize = 0;
+	unsigned int lineno = 0, i;
+	int ret = 1, n;
+	FILE *fp;
+
+	if (argc < 1) {
+		fprintf(stderr, "ERR: missing manifest file name\n");
+		return 1;
+	}
+	fp = fopen(argv[0], "r");
+	if (fp == NULL) {
+		perror(argv[0]);
+		return 1;
+	}
+	if (otp_plan_init(ctx, &plan) < 0) {
+		perror("otp_plan_init");
+		goto depart;
+	}
+	// Settings are collected here, and added to the plan at the end
+	memcpy(words, plan.desired, sizeof(words));
+
+	while (getline(&line, &linesize, fp) >= 0) {
+		lineno += 1;
+		cp = strchr(line, '#');
+		if (cp != NULL)
+			*cp = '\0';
+		key = trim(line);
+		if (*key == '\0')
+			continue;
+		cp = strchr(key, '=');
+		if (cp == NULL) {
+			fprintf(stderr, "%s:%u: expected setting = value\n", argv[0], lineno);
+			goto depart;
 		}
-		if (!opt_quiet)
-			printf("SEC_CONFIG fuse programmed.\n");
+		*cp = '\0';
+		key = trim(key);
+		val = trim(cp + 1);
+
+		if (strcmp(key, "srk-hash") == 0) {
+			char tok[24];
+			size_t toklen;
+			for (i = 0, cp = val; i < SRK_FUSE_COUNT; i++, cp += toklen) {
+				cp += strspn(cp, " \t,");
+				toklen = strcspn(cp, " \t,");
+				if (toklen == 0 || toklen >= sizeof(tok))
+					break;
+				memcpy(tok, cp, toklen);
+				tok[toklen] = '\0';
+				if (parse_u32(tok, &srk_hash[i]) < 0)
+					break;
+			}
+			if (i < SRK_FUSE_COUNT || cp[strspn(cp, " \t,")] != '\0')
+				goto invalid;
+			have_srk = true;
+		} else if (strcmp(key, "srk-fuse-file") == 0) {
+			if (read_fuse_file(val, srk_hash) < 0)
+				goto depart;
+			have_srk = true;
+		} else if (strcmp(key, "mac-address") == 0) {
+			if (sscanf(val, "%2hhx:%2hhx:%2hhx:%2hhx:%2hhx:%2hhx%n",
+				   &macaddr[0], &macaddr[1], &macaddr[2],
+				   &macaddr[3], &macaddr[4], &macaddr[5], &n) != 6 ||
+			    val[n] != '\0')
+				goto invalid;
+			have_mac = true;
+		} else if (strcmp(key, "watchdog") == 0) {
+			value = 0;
+			if (parse_bool(val, &enable) < 0) {
+				if (parse_u32(val, &value) < 0)
+					goto invalid;
+				enable = true;
+			}
+			if (otp_bootcfg_wdog_set(bootcfg, OTP_BOOTCFG_WORD_COUNT, enable, value) < 0)
+				goto invalid;
+		} else if (strcmp(key, "lock") == 0) {
+			if (parse_lock(val, &words[OCOTP_LOCK]) < 0)
+				goto invalid;
+		} else if (strncmp(key, "field", 5) == 0 && isspace((unsigned char) key[5])) {
+			key = trim(key + 5);
+			if (otp_field_lookup(key, &field) < 0) {
+				fprintf(stderr, "%s:%u: unrecognized field: %s\n", argv[0], lineno, key);
+				goto depart;
+			}
+			if (parse_u32(val, &value) < 0 || otp_field_set(ctx, words, field, value) < 0)
+				goto invalid;
+		} else {
+			for (i = 0; i < sizeof(manifest_bootcfg_bools)/sizeof(manifest_bootcfg_bools[0]); i++)
+				if (strcmp(key, manifest_bootcfg_bools[i].name) == 0)
+					break;
+			if (i < sizeof(manifest_bootcfg_bools)/sizeof(manifest_bootcfg_bools[0])) {
+				if (parse_bool(val, &enable) < 0 ||
+				    otp_bootcfg_bool_set(bootcfg, OTP_BOOTCFG_WORD_COUNT,
+							 manifest_bootcfg_bools[i].id, enable) < 0)
+					goto invalid;
+				continue;
+			}
+			for (i = 0; i < sizeof(manifest_fusewords)/sizeof(manifest_fusewords[0]); i++)
+				if (strcmp(key, manifest_fusewords[i].name) == 0)
+					break;
+			if (i >= sizeof(manifest_fusewords)/sizeof(manifest_fusewords[0])) {
+				fprintf(stderr, "%s:%u: unrecognized setting: %s\n", argv[0], lineno, key);
+				goto depart;
+			}
+			if (parse_u32(val, &value) < 0)
+				goto invalid;
+			if (plan.current[manifest_fusewords[i].id] != 0 &&
+			    plan.current[manifest_fusewords[i].id] != value) {
+				fprintf(stderr, "%s:%u: %s already programmed with a different value\n",
+					argv[0], lineno, key);
+				goto depart;
+			}
+			words[manifest_fusewords[i].id] = value;
+		}
+		continue;
+	  invalid:
+		fprintf(stderr, "%s:%u: invalid value for %s: %s\n", argv[0], lineno, key, val);
+		goto depart;
 	}
 
+	for (id = 0; id < OTP_FUSEWORD_COUNT; id++) {
+		if (otp_plan_set(&plan, id, words[id]) < 0) {
+			fprintf(stderr, "ERR: manifest would clear %s fuses that are already set\n",
+				otp_fuseword_name(id));
+			goto depart;
+		}
+	}
+	if (have_srk && otp_srk_plan(&plan, srk_hash, SRK_FUSE_COUNT) < 0) {
+		if (errno == EALREADY)
+			fprintf(stderr, "ERR: SRK fuses already programmed with different hashes\n");
+		else
+			perror("otp_srk_plan");
+		goto depart;
+	}
+	if (have_mac && otp_macaddr_plan(&plan, macaddr) < 0) {
+		if (errno == EALREADY)
+			fprintf(stderr, "ERR: MAC address fuses already programmed with a different address\n");
+		else
+			perror("otp_macaddr_plan");
+		goto depart;
+	}
+	ret = apply_plan(ctx, &plan);
+
+  depart:
+	free(line);
+	fclose(fp);
+	return ret;
+
+} /* do_provision */
+
+/*
+ * do_get_field
+ *
+ * Shows fuse fields.
+ */
+static int
+do_get_field (otpctx_t ctx, int argc, char * const argv[])
+{
+	otp_plan_t plan;
+	otp_field_id_t id;
+	const otp_field_t *field;
+	uint32_t value;
+	int i;
+
+	if (otp_plan_init(ctx, &plan) < 0) {
+		perror("otp_plan_init");
+		return 1;
+	}
+	for (i = 0; i < (argc == 0 ? (int) OTP_FIELD_COUNT : argc); i++) {
+		if (argc == 0)
+			id = (otp_field_id_t) i;
+		else if (otp_field_lookup(argv[i], &id) < 0) {
+			fprintf(stderr, "ERR: unrecognized field: %s\n", argv[i]);
+			return 1;
+		}
+		field = otp_field(ctx, id);
+		otp_field_get(ctx, plan.current, id, &value);
+		if (field->width > 8)
+			printf("%-24.24s 0x%08x\n", field->name, value);
+		else
+			printf("%-24.24s %u\n", field->name, value);
+	}
 	return 0;
 
-} /* do_secure */
+} /* do_get_field */
+
+/*
+ * do_set_field
+ *
+ * Programs fuse fields.
+ */
+static int
+do_set_field (otpctx_t ctx, int argc, char * const argv[])
+{
+	otp_plan_t plan;
+	otp_field_id_t id;
+	uint32_t value;
+	char name[64], *cp;
+	int i;
+
+	if (argc < 1) {
+		fprintf(stderr, "ERR: no fields specified\n");
+		return 1;
+	}
+	if (otp_plan_init(ctx, &plan) < 0) {
+		perror("otp_plan_init");
+		return 1;
+	}
+	for (i = 0; i < argc; i++) {
+		cp = strchr(argv[i], '=');
+		if (cp == NULL || (size_t)(cp - argv[i]) >= sizeof(name)) {
+			fprintf(stderr, "ERR: expected NAME=VALUE: %s\n", argv[i]);
+			return 1;
+		}
+		memcpy(name, argv[i], cp - argv[i]);
+		name[cp - argv[i]] = '\0';
+		if (otp_field_lookup(name, &id) < 0) {
+			fprintf(stderr, "ERR: unrecognized field: %s\n", name);
+			return 1;
+		}
+		if (parse_u32(cp + 1, &value) < 0) {
+			fprintf(stderr, "ERR: invalid value for %s: %s\n", name, cp + 1);
+			return 1;
+		}
+		if (otp_plan_field_set(&plan, id, value) < 0) {
+			if (errno == ERANGE)
+				fprintf(stderr, "ERR: value too large for %s: %s\n", name, cp + 1);
+			else
+				fprintf(stderr, "ERR: %s: cannot clear fuses that are already set\n", name);
+			return 1;
+		}
+	}
+
+	return apply_plan(ctx, &plan);
+
+} /* do_set_field */
 
 /*
  * do_check_secure
@@ -325,6 +776,9 @@ main (int argc, char * const argv[])
 	option_routine_t dispatch = NULL;
 	char *nvmem_path = NULL;
 	char *fuse_file = NULL;
+	char *sim_path = NULL;
+	unsigned long latency_us = 0;
+	char *anchor;
 
 	progname = basename(argv0_copy);
 
@@ -345,9 +799,23 @@ main (int argc, char * const argv[])
 		case 'f':
 			fuse_file = optarg;
 			break;
+		case 'n':
+			opt_dry_run = true;
+			break;
 		case 'q':
 			opt_quiet = true;
 			break;
+		case 's':
+			sim_path = optarg;
+			break;
+		case 'L':
+			latency_us = strtoul(optarg, &anchor, 10);
+			if (anchor == optarg || *anchor != '\0' || latency_us > UINT_MAX) {
+				fprintf(stderr, "Error: invalid programming latency: %s\n", optarg);
+				ret = 1;
+				goto depart;
+			}
+			break;
 		default:
 			fprintf(stderr, "Error: unrecognized option\n");
 			ret = 1;
@@ -359,20 +827,7 @@ main (int argc, char * const argv[])
 	argv += optind;
 
 	if (fuse_file != NULL) {
-		int fd = open(fuse_file, O_RDONLY);
-		ssize_t n;
-		if (fd < 0) {
-			perror(fuse_file);
-			ret = 1;
-			goto depart;
-		}
-		n = read(fd, desired_srk_hash, sizeof(desired_srk_hash));
-		close(fd);
-		if (n != (ssize_t) sizeof(desired_srk_hash)) {
-			if (n < 0)
-				perror(fuse_file);
-			else
-				fprintf(stderr, "%s: file too short\n", fuse_file);
+		if (read_fuse_file(fuse_file, desired_srk_hash) < 0) {
 			ret = 1;
 			goto depart;
 		}
@@ -401,7 +856,13 @@ main (int argc, char * const argv[])
 		goto depart;
 	}
 
-	if (otp_context_open(nvmem_path, false, &ctx) < 0) {
+	if (sim_path != NULL) {
+		if (otp_context_open_simulated(sim_path, false, latency_us, &ctx) < 0) {
+			perror(sim_path);
+			ret = 1;
+			goto depart;
+		}
+	} else if (otp_context_open(nvmem_path, false, &ctx) < 0) {
 		perror("otp_context_open");
 		ret = 1;
 		goto depart;
@@ -13,7 +13,9 @@
  * using (a patched NXP downstream 5.4 kernel) the
  * CONFIG_SECURE_KEYS and CONFIG_ENCRYPTED_KEYS kernel
  * config options, which use CAAM key blobbing to wrap
- * the keys when they are exported to userland.
+ * the keys when they are exported to userland.  A software
+ * key backend, using only standard kernel key types, is
+ * available for testing on other hosts.
  *
  * Copyright (c) 2022, Matthew Madison
  */
@@ -31,34 +33,139 @@
 #include <ctype.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <time.h>
 #include <sys/ioctl.h>
+#include <sys/random.h>
 #include <keyutils.h>
 #include "bootinfo.h"
+#include "dmcrypt.h"
 
 typedef int (*option_routine_t)(void);
 
 #define SSKEY_VARNAME "_ss_key"
 #define SSKEY_NAME    "sskey"
+#define SSKEY_KEYSIZE 32
 #define DMCPP_VARNAME "_dmc_passphrase"
 #define DMCPP_NAME    "dmcryptpp"
+#define BIKEY_VARNAME "_bootinfo_key"
+#define PENDING_VARSUFFIX "_pending"
+#define PENDING_KEYSUFFIX "-pending"
+#define MAX_VOLUMES   16
+#define MAX_VOLNAME   32
+#define DMCPP_KEYSIZE 32
+#define DEFAULT_CIPHER "aes-xts-plain64"
+
+/*
+ * A key slot is an encrypted key, wrapped with the secure
+ * storage key, whose blob is kept in a boot variable.  There
+ * is one for each volume (or one for the default passphrase),
+ * plus one for the bootinfo key with -k.
+ *
+ * During a passphrase rotation, a passphrase slot also has
+ * a pending key, stored and loaded alongside the current one,
+ * that replaces it when the rotation is completed.
+ */
+struct key_slot {
+	char varname[sizeof(DMCPP_VARNAME) + MAX_VOLNAME + 1];
+	char keyname[sizeof(DMCPP_NAME) + MAX_VOLNAME + 1];
+	char label[MAX_VOLNAME + 32];
+	char volname[MAX_VOLNAME + 1];
+	char pending_varname[sizeof(DMCPP_VARNAME) + MAX_VOLNAME + sizeof(PENDING_VARSUFFIX) + 1];
+	char pending_keyname[sizeof(DMCPP_NAME) + MAX_VOLNAME + sizeof(PENDING_KEYSUFFIX) + 1];
+	char *blob;
+	char *pending_blob;
+	char *promoted_blob;
+	bool generate;
+	bool generate_pending;
+	bool passphrase;
+	const char *device;
+};
+
+enum rotate_mode {
+	ROTATE_NONE,
+	ROTATE_STAGE,
+	ROTATE_PROMOTE,
+};
+
+/*
+ * Phases timed for --timing and --benchmark
+ */
+enum timing_phase {
+	TIME_STORE_OPEN,
+	TIME_SSKEY_ADD,
+	TIME_SSKEY_READ,
+	TIME_KEY_ADD,
+	TIME_KEY_READ,
+	TIME_STORE_UPDATE,
+	TIME_TOTAL,
+	TIME_PHASE_COUNT
+};
+static const char *timing_phase_names[TIME_PHASE_COUNT] = {
+	[TIME_STORE_OPEN]	= "bootinfo open",
+	[TIME_SSKEY_ADD]	= "secure key add_key",
+	[TIME_SSKEY_READ]	= "secure key read",
+	[TIME_KEY_ADD]		= "encrypted key add_key",
+	[TIME_KEY_READ]		= "encrypted key read",
+	[TIME_STORE_UPDATE]	= "bootinfo update",
+	[TIME_TOTAL]		= "total",
+};
+struct timing_stats {
+	unsigned int count;
+	uint64_t total, min, max;
+};
+
+/*
+ * A key backend provides the secure storage key, which
+ * wraps the encrypted keys.  new_payload and load_payload
+ * build the add_key payload for generating a new key or
+ * loading one from its stored text, returning the payload
+ * length; export converts what the keyring returns for the
+ * key into the text that is stored, taking ownership of
+ * the keyring buffer.
+ */
+struct key_backend {
+	const char *name;
+	const char *keytype;
+	int (*new_payload)(char *payload, size_t size);
+	int (*load_payload)(const char *stored, char *payload, size_t size);
+	char *(*export)(void *keybuf, long keylen);
+};
 
 static struct option options[] = {
 	{ "dmc-passphrase",	no_argument,		0, 'p' },
 	{ "file-passphrase",	no_argument,		0, 'f' },
 	{ "bootdone",		no_argument,		0, 'b' },
 	{ "generate",           no_argument,            0, 'g' },
+	{ "bootinfo-key",       no_argument,            0, 'k' },
 	{ "output",             required_argument,	0, 'o' },
+	{ "volume",             required_argument,	0, 'v' },
+	{ "activate",           required_argument,	0, 'a' },
+	{ "cipher",             required_argument,	0, 'c' },
+	{ "key-backend",        required_argument,	0, 'K' },
+	{ "rotate",             no_argument,		0, 'r' },
+	{ "promote",            no_argument,		0, 'P' },
+	{ "timing",             no_argument,		0, 't' },
+	{ "benchmark",          required_argument,	0, 'B' },
 	{ "help",		no_argument,		0, 'h' },
 	{ 0,			0,			0, 0   }
 };
-static const char *shortopts = ":pfbgo:h";
+static const char *shortopts = ":pfbgko:v:a:c:K:rPtB:h";
 
 static char *optarghelp[] = {
 	"--dmc-passphrase     ",
 	"--file-passphrase    ",
 	"--bootdone           ",
 	"--generate           ",
+	"--bootinfo-key       ",
 	"--output             ",
+	"--volume NAME        ",
+	"--activate NAME:DEV  ",
+	"--cipher CIPHER      ",
+	"--key-backend NAME   ",
+	"--rotate             ",
+	"--promote            ",
+	"--timing             ",
+	"--benchmark COUNT    ",
 	"--help               ",
 };
 
@@ -67,11 +174,28 @@ static char *opthelp[] = {
 	"extract the file passphrase",
 	"set booting complete",
 	"force generation of new passphrase",
-	"file to write the passphrase to instead of stdout",
+	"also set up the key for authenticated bootinfo stores",
+	"not supported (the kernel only exports passphrases wrapped)",
+	"set up the passphrase for volume NAME (may be repeated)",
+	"also map plain dm-crypt device DEV as NAME with its passphrase (may be repeated)",
+	"dm-crypt cipher for --activate (default: " DEFAULT_CIPHER ")",
+	"key backend: caam or software (default: " KEY_BACKEND ")",
+	"generate new pending passphrases, keeping the current ones",
+	"replace the current passphrases with the pending ones",
+	"report the time taken by each step on stderr",
+	"repeat loading and verifying the keys COUNT times, and report timing",
 	"display this help text"
 };
 
 static bool force_generate = false;
+static bool setup_bootinfo_key = false;
+static struct key_slot key_slots[MAX_VOLUMES + 1];
+static unsigned int slot_count;
+static const char *dmcrypt_cipher = DEFAULT_CIPHER;
+static enum rotate_mode rotate_mode = ROTATE_NONE;
+static bool timing = false;
+static unsigned long benchmark_count;
+static struct timing_stats timing_stats[TIME_PHASE_COUNT];
 
 
 /*
@@ -95,39 +219,288 @@ print_usage (void)
 } /* print_usage */
 
 /*
- * setup_passphrase
+ * add_key_slot
+ *
+ * Adds a key slot for a volume, or for the default
+ * passphrase if volname is NULL.  A volume that has
+ * already been added gets its existing slot.
+ *
+ * returns pointer to the slot, NULL on error.
+ */
+static struct key_slot *
+add_key_slot (const char *volname)
+{
+	struct key_slot *slot;
+	const char *cp, *varsep = "", *keysep = "", *vol = "";
+	unsigned int i;
+
+	if (volname != NULL)
+		for (i = 0; i < slot_count; i++)
+			if (strcmp(key_slots[i].volname, volname) == 0)
+				return &key_slots[i];
+	if (slot_count >= MAX_VOLUMES) {
+		fprintf(stderr, "Error: too many volumes (maximum %d)\n", MAX_VOLUMES);
+		return NULL;
+	}
+	slot = &key_slots[slot_count];
+	if (volname == NULL)
+		strcpy(slot->label, "passphrase");
+	else {
+		/*
+		 * The volume name becomes part of a variable
+		 * name, so it is restricted to the same characters.
+		 */
+		for (cp = volname; *cp != '\0' && (isalnum(*cp) || *cp == '_'); cp++);
+		if (*volname == '\0' || *cp != '\0' || cp - volname > MAX_VOLNAME) {
+			fprintf(stderr, "Error: invalid volume name: %s\n", volname);
+			return NULL;
+		}
+		strcpy(slot->volname, volname);
+		sprintf(slot->label, "passphrase for %s", volname);
+		varsep = "_";
+		keysep = "-";
+		vol = volname;
+	}
+	/*
+	 * The pending names are built from the same parts as
+	 * the current ones, rather than by appending to them.
+	 */
+	if ((size_t) snprintf(slot->varname, sizeof(slot->varname), "%s%s%s",
+			      DMCPP_VARNAME, varsep, vol) >= sizeof(slot->varname) ||
+	    (size_t) snprintf(slot->keyname, sizeof(slot->keyname), "%s%s%s",
+			      DMCPP_NAME, keysep, vol) >= sizeof(slot->keyname) ||
+	    (size_t) snprintf(slot->pending_varname, sizeof(slot->pending_varname), "%s%s%s%s",
+			      DMCPP_VARNAME, varsep, vol, PENDING_VARSUFFIX) >= sizeof(slot->pending_varname) ||
+	    (size_t) snprintf(slot->pending_keyname, sizeof(slot->pending_keyname), "%s%s%s%s",
+			      DMCPP_NAME, keysep, vol, PENDING_KEYSUFFIX) >= sizeof(slot->pending_keyname)) {
+		fprintf(stderr, "Error: volume name too long: %s\n", vol);
+		return NULL;
+	}
+	slot->passphrase = true;
+	slot_count += 1;
+	return slot;
+
+} /* add_key_slot */
+
+/*
+ * timing_start
+ *
+ * Returns the current time in nanoseconds, if timing.
+ */
+static uint64_t
+timing_start (void)
+{
+	struct timespec ts;
+
+	if (!timing)
+		return 0;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+} /* timing_start */
+
+/*
+ * timing_end
+ *
+ * Adds the time since start to the statistics
+ * for a phase.
+ */
+static void
+timing_end (enum timing_phase phase, uint64_t start)
+{
+	struct timing_stats *st = &timing_stats[phase];
+	uint64_t elapsed;
+
+	if (!timing)
+		return;
+	elapsed = timing_start() - start;
+	if (st->count == 0 || elapsed < st->min)
+		st->min = elapsed;
+	if (elapsed > st->max)
+		st->max = elapsed;
+	st->total += elapsed;
+	st->count += 1;
+
+} /* timing_end */
+
+/*
+ * timing_report
+ */
+static void
+timing_report (void)
+{
+	struct timing_stats *st;
+	unsigned int i;
+
+	fprintf(stderr, "%-24s %8s %12s %10s %10s %10s\n",
+		"phase", "count", "total(us)", "mean(us)", "min(us)", "max(us)");
+	for (i = 0; i < TIME_PHASE_COUNT; i++) {
+		st = &timing_stats[i];
+		if (st->count == 0)
+			continue;
+		fprintf(stderr, "%-24s %8u %12.1f %10.1f %10.1f %10.1f\n",
+			timing_phase_names[i], st->count, st->total / 1000.0,
+			st->total / 1000.0 / st->count, st->min / 1000.0, st->max / 1000.0);
+	}
+
+} /* timing_report */
+
+/*
+ * caam_new_payload
+ */
+static int
+caam_new_payload (char *payload, size_t size)
+{
+	return snprintf(payload, size, "new %u", SSKEY_KEYSIZE);
+
+} /* caam_new_payload */
+
+/*
+ * caam_load_payload
+ *
+ * The stored text is the hex blob of the key,
+ * wrapped by the CAAM.
+ */
+static int
+caam_load_payload (const char *stored, char *payload, size_t size)
+{
+	int len = snprintf(payload, size, "load %s", stored);
+
+	if (len < 0 || (size_t) len >= size) {
+		errno = EINVAL;
+		return -1;
+	}
+	return len;
+
+} /* caam_load_payload */
+
+/*
+ * caam_export
+ */
+static char *
+caam_export (void *keybuf, long keylen)
+{
+	return keybuf;
+
+} /* caam_export */
+
+/*
+ * software_new_payload
+ *
+ * A user key's payload is the key itself.
+ */
+static int
+software_new_payload (char *payload, size_t size)
+{
+	if (size < SSKEY_KEYSIZE) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (getrandom(payload, SSKEY_KEYSIZE, 0) != SSKEY_KEYSIZE)
+		return -1;
+	return SSKEY_KEYSIZE;
+
+} /* software_new_payload */
+
+/*
+ * software_load_payload
  *
- * Installs (or creates) the secure storage key and passphrase
- * into the kernel keyring for the current UID.
+ * The stored text is the key in hex.
+ */
+static int
+software_load_payload (const char *stored, char *payload, size_t size)
+{
+	size_t len = strlen(stored) / 2;
+	unsigned int i, byte;
+
+	if (len == 0 || len > size || strlen(stored) != len * 2) {
+		errno = EINVAL;
+		return -1;
+	}
+	for (i = 0; i < len; i++) {
+		if (!isxdigit(stored[i*2]) || !isxdigit(stored[i*2+1]) ||
+		    sscanf(&stored[i*2], "%2x", &byte) != 1) {
+			errno = EINVAL;
+			return -1;
+		}
+		payload[i] = byte;
+	}
+	return len;
+
+} /* software_load_payload */
+
+/*
+ * software_export
+ */
+static char *
+software_export (void *keybuf, long keylen)
+{
+	char *text = malloc(keylen * 2 + 1);
+	long i;
+
+	if (text != NULL)
+		for (i = 0; i < keylen; i++)
+			sprintf(&text[i*2], "%02x", ((unsigned char *) keybuf)[i]);
+	explicit_bzero(keybuf, keylen);
+	free(keybuf);
+	return text;
+
+} /* software_export */
+
+/*
+ * The caam backend uses the "secure" key type from the NXP
+ * kernel, which is generated by and wrapped with the CAAM.
+ * The software backend is a stand-in for testing on hosts
+ * without a CAAM: it uses a standard "user" key, which is
+ * stored in the clear, so it provides no protection.
+ */
+static const struct key_backend key_backends[] = {
+	{ "caam",	"secure", caam_new_payload, caam_load_payload, caam_export },
+	{ "software",	"user", software_new_payload, software_load_payload, software_export },
+};
+static const struct key_backend *backend;
+
+/*
+ * setup_sskey
+ *
+ * Installs (or creates) the secure storage key
+ * into the kernel keyring for the current UID.  A key
+ * that is already in the keyring is read back and
+ * checked against the stored one.
  *
  * returns 0 on success, negative number on error.
  */
 static int
-setup_passphrase (bool generate, char **sskeyptr, char **dmcppptr)
+setup_sskey (bool generate, char **sskeyptr)
 {
-	key_serial_t ssk, dmcpp;
+	key_serial_t ssk;
 	void *keybuf;
+	char *keytext;
 	char payload[1024];
-	static const char loadcmd[] = "load ";
+	uint64_t start;
+	bool loaded = false;
+	long keylen;
+	int len;
 
-	ssk = find_key_by_type_and_desc("secure", SSKEY_NAME, KEY_SPEC_USER_KEYRING);
+	ssk = find_key_by_type_and_desc(backend->keytype, SSKEY_NAME, KEY_SPEC_USER_KEYRING);
 	if (ssk < 0) {
-		if (!generate && *sskeyptr != NULL) {
-			if (strlen(*sskeyptr) + sizeof(loadcmd) >= sizeof(payload)) {
-				errno = EINVAL;
-				return -1;
-			}
-			snprintf(payload, sizeof(payload)-1, "%s%s", loadcmd, *sskeyptr);
-			payload[sizeof(payload)-1] = '\0';
-		} else
-			strcpy(payload, "new 32");
+		loaded = !generate && *sskeyptr != NULL;
+		if (loaded)
+			len = backend->load_payload(*sskeyptr, payload, sizeof(payload));
+		else
+			len = backend->new_payload(payload, sizeof(payload));
+		if (len < 0)
+			return -1;
 		/*
 		 * Default permissions on a key in the user keyring only grants read/write/etc. permission
 		 * to the possessor of a key, so we have to create it in the session keyring, change
 		 * the permissions and link the key to the user keyring so it can be used by other
 		 * processes/
 		 */
-		ssk = add_key("secure", SSKEY_NAME, payload, strlen(payload), KEY_SPEC_SESSION_KEYRING);
+		start = timing_start();
+		ssk = add_key(backend->keytype, SSKEY_NAME, payload, len, KEY_SPEC_SESSION_KEYRING);
+		timing_end(TIME_SSKEY_ADD, start);
+		explicit_bzero(payload, sizeof(payload));
 		if (ssk < 0)
 			return -1;
 		if (keyctl_setperm(ssk, KEY_POS_ALL|KEY_USR_ALL|KEY_GRP_VIEW|KEY_GRP_SEARCH|KEY_OTH_VIEW|KEY_OTH_SEARCH) < 0)
@@ -141,106 +514,557 @@ setup_passphrase (bool generate, char **sskeyptr, char **dmcppptr)
 		 */
 		keyctl_link(ssk, KEY_SPEC_SESSION_KEYRING);
 	}
-	if (keyctl_read_alloc(ssk, &keybuf) < 0)
+	/*
+	 * A key just loaded from the stored blob needs no check
+	 * against it: the kernel accepted that blob, and reading
+	 * the key back would only export it again (another CAAM
+	 * round trip with the caam backend).
+	 */
+	if (loaded)
+		return 0;
+	start = timing_start();
+	keylen = keyctl_read_alloc(ssk, &keybuf);
+	timing_end(TIME_SSKEY_READ, start);
+	if (keylen < 0)
+		return -1;
+	keytext = backend->export(keybuf, keylen);
+	if (keytext == NULL)
 		return -1;
 	if (generate || *sskeyptr == NULL)
-		*sskeyptr = keybuf;
-	else if (strcmp(*sskeyptr, keybuf) != 0) {
+		*sskeyptr = keytext;
+	else if (strcmp(*sskeyptr, keytext) != 0) {
 		errno = EIO;
 		fputs("Error: secure storage key mismatch with keyring\n", stderr);
-		free(keybuf);
+		free(keytext);
 		return -1;
 	} else
-		free(keybuf);
+		free(keytext);
+	return 0;
+
+} /* setup_sskey */
+
+/*
+ * setup_encrypted_key
+ *
+ * Installs (or creates) an encrypted key, wrapped with
+ * the secure storage key, into the kernel keyring for the
+ * current UID.  The secure storage key must already be
+ * set up.
+ *
+ * returns 0 on success, negative number on error.
+ */
+static int
+setup_encrypted_key (const char *keyname, const char *label, bool generate, char **blobptr)
+{
+	key_serial_t key;
+	void *keybuf;
+	char payload[1024];
+	static const char loadcmd[] = "load ";
+	uint64_t start;
+	bool loaded = false;
+	long keylen;
 
-	dmcpp = find_key_by_type_and_desc("encrypted", DMCPP_NAME, KEY_SPEC_USER_KEYRING);
-	if (dmcpp < 0) {
-		if (!generate && *dmcppptr != NULL) {
-		        if (strlen(*dmcppptr) + sizeof(loadcmd) >= sizeof(payload)) {
+	key = find_key_by_type_and_desc("encrypted", keyname, KEY_SPEC_USER_KEYRING);
+	if (key < 0) {
+		loaded = !generate && *blobptr != NULL;
+		if (loaded) {
+		        if (strlen(*blobptr) + sizeof(loadcmd) >= sizeof(payload)) {
 				errno = EINVAL;
 				return -1;
 			}
-			snprintf(payload, sizeof(payload)-1, "%s%s", loadcmd, *dmcppptr);
+			snprintf(payload, sizeof(payload)-1, "%s%s", loadcmd, *blobptr);
 			payload[sizeof(payload)-1] = '\0';
 		} else
-			strcpy(payload, "new default secure:" SSKEY_NAME " 32");
-		dmcpp = add_key("encrypted", DMCPP_NAME, payload, strlen(payload), KEY_SPEC_SESSION_KEYRING);
-		if (dmcpp < 0)
+			sprintf(payload, "new default %s:%s %u", backend->keytype, SSKEY_NAME, DMCPP_KEYSIZE);
+		start = timing_start();
+		key = add_key("encrypted", keyname, payload, strlen(payload), KEY_SPEC_SESSION_KEYRING);
+		timing_end(TIME_KEY_ADD, start);
+		if (key < 0)
 			return -1;
-		if (keyctl_setperm(dmcpp, KEY_POS_ALL|KEY_USR_ALL|KEY_GRP_VIEW|KEY_GRP_SEARCH|KEY_OTH_VIEW|KEY_OTH_SEARCH) < 0)
+		if (keyctl_setperm(key, KEY_POS_ALL|KEY_USR_ALL|KEY_GRP_VIEW|KEY_GRP_SEARCH|KEY_OTH_VIEW|KEY_OTH_SEARCH) < 0)
 			return -1;
-		if (keyctl_link(dmcpp, KEY_SPEC_USER_KEYRING) < 0)
+		if (keyctl_link(key, KEY_SPEC_USER_KEYRING) < 0)
 			return -1;
 	}
-	if (keyctl_read_alloc(dmcpp, &keybuf) < 0)
+	/* as for the secure storage key, no readback is needed */
+	if (loaded)
+		return 0;
+	start = timing_start();
+	keylen = keyctl_read_alloc(key, &keybuf);
+	timing_end(TIME_KEY_READ, start);
+	if (keylen < 0)
 		return -1;
-	if (generate || *dmcppptr == NULL)
-		*dmcppptr = keybuf;
-	else if (strcmp(*dmcppptr, keybuf) != 0) {
+	if (generate || *blobptr == NULL)
+		*blobptr = keybuf;
+	else if (strcmp(*blobptr, keybuf) != 0) {
 		errno = EIO;
-		fputs("Error: passphrase mismatch with keyring\n", stderr);
+		fprintf(stderr, "Error: %s mismatch with keyring\n", label);
 		free(keybuf);
 		return -1;
 	} else
 		free(keybuf);
 	return 0;
 
+} /* setup_encrypted_key */
+
+/*
+ * invalidate_key
+ *
+ * Removes an encrypted key from the keyring, if present.
+ */
+static void
+invalidate_key (const char *keyname)
+{
+	key_serial_t key;
+
+	key = find_key_by_type_and_desc("encrypted", keyname, KEY_SPEC_USER_KEYRING);
+	if (key >= 0)
+		keyctl_invalidate(key);
+
+} /* invalidate_key */
+
+/*
+ * setup_passphrase
+ *
+ * Installs (or creates) the secure storage key and the keys
+ * for all of the key slots, including any pending keys, into
+ * the kernel keyring for the current UID.
+ *
+ * returns 0 on success, negative number on error.
+ */
+static int
+setup_passphrase (bool generate, char **sskeyptr)
+{
+	struct key_slot *slot;
+	unsigned int i;
+
+	if (setup_sskey(generate, sskeyptr) < 0) {
+		perror(generate ? "generate_passphrase" : "setup_passphrase");
+		return -1;
+	}
+	for (i = 0; i < slot_count; i++) {
+		slot = &key_slots[i];
+		if (setup_encrypted_key(slot->keyname, slot->label,
+					slot->generate, &slot->blob) < 0) {
+			fprintf(stderr, "%s (%s): %s\n",
+				slot->generate ? "generate_passphrase" : "setup_passphrase",
+				slot->keyname, strerror(errno));
+			return -1;
+		}
+		if (slot->pending_blob == NULL && !slot->generate_pending)
+			continue;
+		/*
+		 * Make sure a new pending key is generated, rather than
+		 * reusing one left in the keyring by an earlier run.
+		 */
+		if (slot->generate_pending)
+			invalidate_key(slot->pending_keyname);
+		if (setup_encrypted_key(slot->pending_keyname, "pending passphrase",
+					slot->generate_pending, &slot->pending_blob) < 0) {
+			fprintf(stderr, "%s (%s): %s\n",
+				slot->generate_pending ? "generate_passphrase" : "setup_passphrase",
+				slot->pending_keyname, strerror(errno));
+			return -1;
+		}
+	}
+	return 0;
+
 } /* setup_passphrase */
 
+/*
+ * lookup_keys
+ *
+ * Fetches the stored key blobs from boot variable storage,
+ * returning true if the store needs updating, because some
+ * of them have to be generated or a rotation is in progress.
+ * All of the slot keys are wrapped with the secure storage
+ * key, so they all have to be generated if it is, and any
+ * pending keys are dropped.
+ */
+static bool
+lookup_keys (bootinfo_ctx_t *ctx, char **sskeyptr, bool *generate_sskey)
+{
+	struct key_slot *slot;
+	unsigned int i;
+	bool generate;
+
+	*sskeyptr = NULL;
+	*generate_sskey = (force_generate ||
+			   bootinfo_bootvar_get(ctx, SSKEY_VARNAME, sskeyptr) < 0);
+	generate = *generate_sskey || rotate_mode != ROTATE_NONE;
+	for (i = 0; i < slot_count; i++) {
+		slot = &key_slots[i];
+		slot->blob = slot->pending_blob = NULL;
+		slot->generate = (*generate_sskey ||
+				  bootinfo_bootvar_get(ctx, slot->varname, &slot->blob) < 0);
+		slot->generate_pending = (slot->passphrase && rotate_mode == ROTATE_STAGE);
+		if (slot->passphrase && !slot->generate_pending &&
+		    bootinfo_bootvar_get(ctx, slot->pending_varname, &slot->pending_blob) == 0 &&
+		    *generate_sskey) {
+			slot->pending_blob = NULL;
+			generate = true;
+		}
+		generate = generate || slot->generate;
+	}
+	return generate;
+
+} /* lookup_keys */
+
+/*
+ * activate_volumes
+ *
+ * Maps the volumes given with --activate, with the
+ * dm-crypt target referring to each volume's passphrase
+ * in the keyring by its description.
+ *
+ * returns 0 on success, negative number on error.
+ */
+static int
+activate_volumes (void)
+{
+	char keyspec[sizeof(DMCPP_NAME) + MAX_VOLNAME + 32];
+	key_serial_t key;
+	unsigned int i;
+
+	for (i = 0; i < slot_count; i++) {
+		if (key_slots[i].device == NULL)
+			continue;
+		/*
+		 * dm-crypt looks the key up through this process's
+		 * keyrings, so make sure it is in the session keyring.
+		 */
+		key = find_key_by_type_and_desc("encrypted", key_slots[i].keyname, KEY_SPEC_USER_KEYRING);
+		if (key < 0 || keyctl_link(key, KEY_SPEC_SESSION_KEYRING) < 0) {
+			fprintf(stderr, "%s: %s\n", key_slots[i].keyname, strerror(errno));
+			return -1;
+		}
+		snprintf(keyspec, sizeof(keyspec), ":%u:encrypted:%s", DMCPP_KEYSIZE, key_slots[i].keyname);
+		if (dmcrypt_activate(key_slots[i].volname, key_slots[i].device,
+				     dmcrypt_cipher, keyspec) < 0) {
+			if (errno == EOPNOTSUPP)
+				fprintf(stderr, "%s: kernel dm-crypt does not support encrypted keys\n",
+					key_slots[i].device);
+			else
+				fprintf(stderr, "%s: %s\n", key_slots[i].device, strerror(errno));
+			return -1;
+		}
+	}
+	return 0;
+
+} /* activate_volumes */
+
+/*
+ * set_key_var
+ *
+ * Stores (or, with a NULL value, deletes) a key blob
+ * variable.  Deleting a variable that is not present
+ * is not an error.
+ *
+ * returns 0 on success, 1 on error.
+ */
+static int
+set_key_var (bootinfo_ctx_t *ctx, const char *name, const char *value)
+{
+	if (bootinfo_bootvar_set(ctx, name, value) < 0 &&
+	    !(value == NULL && errno == ENOENT)) {
+		perror("bootinfo_bootvar_set");
+		return 1;
+	}
+	return 0;
+
+} /* set_key_var */
+
+/*
+ * reload_promoted
+ *
+ * After pending keys have been promoted in the store,
+ * replaces the current keys in the keyring with them.
+ * Keys cannot be renamed, so the pending keys are removed
+ * and loaded again under the current descriptions.
+ *
+ * returns 0 on success, negative number on error.
+ */
+static int
+reload_promoted (void)
+{
+	struct key_slot *slot;
+	unsigned int i;
+
+	for (i = 0; i < slot_count; i++) {
+		slot = &key_slots[i];
+		if (slot->promoted_blob == NULL)
+			continue;
+		invalidate_key(slot->keyname);
+		invalidate_key(slot->pending_keyname);
+		if (setup_encrypted_key(slot->keyname, slot->label, false, &slot->promoted_blob) < 0) {
+			fprintf(stderr, "setup_passphrase (%s): %s\n", slot->keyname, strerror(errno));
+			return -1;
+		}
+	}
+	return 0;
+
+} /* reload_promoted */
+
 /*
  * get_passphrase
  *
  * Retrieves the secure storage key and dm-crypt passphrase hex blobs from
  * boot variable storage (if present) and installs them in the user keyring,
  * or generates new ones if '-g' is used, or if one of the keys is missing.
+ * With '-v', there is a passphrase for each named volume instead of the
+ * single default one; they are all loaded with one read of the store,
+ * and any newly generated blobs are saved with one update.  Volumes
+ * named with '-a' are then mapped with dm-crypt.
+ *
+ * Passphrases are rotated in two steps, so that the volumes can be
+ * given the new passphrases while the current ones still work.  With
+ * '-r', new pending passphrases are generated and stored alongside the
+ * current ones; after that, every run loads both.  With '-P', the
+ * pending passphrases replace the current ones, in a single update.
+ *
+ * With '-k', the key for authenticated bootinfo stores is handled the
+ * same way.  It is wrapped with the secure storage key, so it gets
+ * regenerated whenever that key is.
+ *
+ * Normally the keys are already stored and only need to be loaded,
+ * so the store is opened read-only at first, which avoids taking the
+ * exclusive lock and making the boot device writeable.  It is reopened
+ * read-write only when keys have to be generated.
  */
 static int
 get_passphrase (void)
 {
 	bootinfo_ctx_t *ctx;
-	char *sskeytext = NULL, *ppblobtext = NULL;
-	bool generate = force_generate;
+	struct key_slot *slot;
+	char *sskeytext;
+	bool update, generate_sskey;
+	bool readwrite = true;
+	uint64_t start;
+	unsigned int i;
+	int ret = 0;
 
-	if (bootinfo_open(&ctx, 0) < 0) {
-		perror("bootinfo_open");
+	if (slot_count == 0 && add_key_slot(NULL) == NULL)
 		return 1;
+	if (setup_bootinfo_key) {
+		strcpy(key_slots[slot_count].varname, BIKEY_VARNAME);
+		strcpy(key_slots[slot_count].keyname, BOOTINFO_HMAC_KEY_NAME);
+		strcpy(key_slots[slot_count].label, "bootinfo key");
+		slot_count += 1;
 	}
-	if (!generate)
-		generate = (bootinfo_bootvar_get(ctx, SSKEY_VARNAME, &sskeytext) < 0 ||
-			    bootinfo_bootvar_get(ctx, DMCPP_VARNAME, &ppblobtext) < 0);
-	if (generate) {
-		int ret;
-		if (setup_passphrase(true, &sskeytext, &ppblobtext) < 0) {
-			perror("generate_passphrase");
+
+	start = timing_start();
+	if (!force_generate && bootinfo_open(&ctx, BOOTINFO_O_RDONLY) == 0) {
+		readwrite = lookup_keys(ctx, &sskeytext, &generate_sskey);
+		timing_end(TIME_STORE_OPEN, start);
+		if (readwrite)
 			bootinfo_close(ctx);
+	}
+	/*
+	 * Recheck after a read-write open, since another
+	 * process could have stored the keys in the meantime.
+	 */
+	if (readwrite) {
+		start = timing_start();
+		if (bootinfo_open(&ctx, 0) < 0) {
+			perror("bootinfo_open");
 			return 1;
 		}
-		ret = bootinfo_bootvar_set(ctx, DMCPP_VARNAME, ppblobtext);
-		if (ret == 0)
-			ret = bootinfo_bootvar_set(ctx, SSKEY_VARNAME, sskeytext);
-		if (ret != 0) {
-			perror("bootinfo_bootvar_set");
-			bootinfo_close(ctx);
-			return 1;
+		lookup_keys(ctx, &sskeytext, &generate_sskey);
+		timing_end(TIME_STORE_OPEN, start);
+	}
+	if (setup_passphrase(generate_sskey, &sskeytext) < 0) {
+		ret = 1;
+		goto depart;
+	}
+	update = generate_sskey || rotate_mode != ROTATE_NONE;
+	for (i = 0; i < slot_count && ret == 0; i++) {
+		slot = &key_slots[i];
+		if (slot->generate) {
+			update = true;
+			ret = set_key_var(ctx, slot->varname, slot->blob);
 		}
-		ret = bootinfo_update(ctx);
-		// These were allocated by libkeyutils, must be freed
-		free(ppblobtext);
-		free(sskeytext);
-		if (ret != 0) {
+		if (ret != 0 || !slot->passphrase)
+			continue;
+		if (rotate_mode == ROTATE_STAGE)
+			ret = set_key_var(ctx, slot->pending_varname, slot->pending_blob);
+		else if (rotate_mode == ROTATE_PROMOTE) {
+			if (slot->pending_blob == NULL) {
+				fprintf(stderr, "Error: no pending %s\n", slot->label);
+				ret = 1;
+				continue;
+			}
+			slot->promoted_blob = strdup(slot->pending_blob);
+			if (slot->promoted_blob == NULL) {
+				perror("strdup");
+				ret = 1;
+				continue;
+			}
+			ret = set_key_var(ctx, slot->varname, slot->promoted_blob);
+			if (ret == 0)
+				ret = set_key_var(ctx, slot->pending_varname, NULL);
+		} else if (generate_sskey) {
+			/* any pending key was wrapped with the old secure storage key */
+			ret = set_key_var(ctx, slot->pending_varname, NULL);
+		}
+	}
+	if (ret == 0 && generate_sskey)
+		ret = set_key_var(ctx, SSKEY_VARNAME, sskeytext);
+	if (ret == 0 && update) {
+		start = timing_start();
+		if (bootinfo_update(ctx) < 0) {
 			perror("bootinfo_update");
+			ret = 1;
+		}
+		timing_end(TIME_STORE_UPDATE, start);
+	}
+
+  depart:
+	// Generated blobs were allocated by libkeyutils, must be freed
+	if (generate_sskey)
+		free(sskeytext);
+	for (i = 0; i < slot_count; i++) {
+		if (key_slots[i].generate)
+			free(key_slots[i].blob);
+		if (key_slots[i].generate_pending)
+			free(key_slots[i].pending_blob);
+	}
+	bootinfo_close(ctx);
+	if (ret == 0 && rotate_mode == ROTATE_PROMOTE && reload_promoted() < 0)
+		ret = 1;
+	for (i = 0; i < slot_count; i++)
+		free(key_slots[i].promoted_blob);
+	if (ret == 0 && activate_volumes() < 0)
+		ret = 1;
+	return ret;
+
+} /* get_passphrase */
+
+/*
+ * benchmark_key
+ *
+ * Adds a key to the session keyring and reads it back,
+ * timing each step.  The benchmark runs in a private session
+ * keyring, so the key is never linked into the user keyring.
+ *
+ * returns 0 on success, negative number on error.
+ */
+static int
+benchmark_key (const char *keytype, const char *keyname, const void *payload, size_t len,
+	       enum timing_phase addphase, enum timing_phase readphase)
+{
+	key_serial_t key;
+	void *keybuf;
+	uint64_t start;
+	long keylen;
+
+	start = timing_start();
+	key = add_key(keytype, keyname, payload, len, KEY_SPEC_SESSION_KEYRING);
+	timing_end(addphase, start);
+	if (key < 0)
+		return -1;
+	start = timing_start();
+	keylen = keyctl_read_alloc(key, &keybuf);
+	timing_end(readphase, start);
+	if (keylen < 0)
+		return -1;
+	explicit_bzero(keybuf, keylen);
+	free(keybuf);
+	return 0;
+
+} /* benchmark_key */
+
+/*
+ * benchmark_blob
+ *
+ * Loads an encrypted key from its stored blob for
+ * the benchmark, and reads it back.
+ *
+ * returns 0 on success, negative number on error.
+ */
+static int
+benchmark_blob (const char *keyname, const char *blob)
+{
+	char payload[1024];
+	int len;
+
+	len = snprintf(payload, sizeof(payload), "load %s", blob);
+	if (len < 0 || (size_t) len >= sizeof(payload)) {
+		errno = EINVAL;
+		return -1;
+	}
+	return benchmark_key("encrypted", keyname, payload, len, TIME_KEY_ADD, TIME_KEY_READ);
+
+} /* benchmark_blob */
+
+/*
+ * run_benchmark
+ *
+ * Sets up the keys as for get_passphrase, then repeatedly
+ * loads them from the store, as on a normal boot, reading
+ * each back after it is loaded, and timing each step of
+ * the cycle.  The cycle runs in a private session keyring,
+ * which is cleared after each pass, so the keys in the user
+ * keyring are left alone, and the secure storage key the
+ * blobs refer to is found in the private keyring.
+ */
+static int
+run_benchmark (void)
+{
+	bootinfo_ctx_t *ctx;
+	char *sskeytext;
+	char payload[1024];
+	bool generate_sskey;
+	unsigned long n;
+	unsigned int i;
+	uint64_t start, cycle_start;
+	int len, ret;
+
+	ret = get_passphrase();
+	if (ret != 0)
+		return ret;
+	memset(timing_stats, 0, sizeof(timing_stats));
+	rotate_mode = ROTATE_NONE;
+	force_generate = false;
+	if (keyctl_join_session_keyring(NULL) < 0) {
+		perror("keyctl_join_session_keyring");
+		return 1;
+	}
+
+	for (n = 0; n < benchmark_count; n++) {
+		cycle_start = start = timing_start();
+		if (bootinfo_open(&ctx, BOOTINFO_O_RDONLY) < 0) {
+			perror("bootinfo_open");
+			return 1;
+		}
+		if (lookup_keys(ctx, &sskeytext, &generate_sskey)) {
+			fprintf(stderr, "Error: keys missing from store\n");
 			bootinfo_close(ctx);
 			return 1;
 		}
-	} else if (setup_passphrase(false, &sskeytext, &ppblobtext) < 0) {
-		perror("setup_passphrase");
+		timing_end(TIME_STORE_OPEN, start);
+		len = backend->load_payload(sskeytext, payload, sizeof(payload));
+		ret = (len < 0 ? -1 : benchmark_key(backend->keytype, SSKEY_NAME, payload, len,
+						    TIME_SSKEY_ADD, TIME_SSKEY_READ));
+		explicit_bzero(payload, sizeof(payload));
+		for (i = 0; ret == 0 && i < slot_count; i++) {
+			ret = benchmark_blob(key_slots[i].keyname, key_slots[i].blob);
+			if (ret == 0 && key_slots[i].pending_blob != NULL)
+				ret = benchmark_blob(key_slots[i].pending_keyname, key_slots[i].pending_blob);
+		}
 		bootinfo_close(ctx);
-		return 1;
+		timing_end(TIME_TOTAL, cycle_start);
+		if (ret < 0) {
+			perror("benchmark");
+			return 1;
+		}
+		if (keyctl_clear(KEY_SPEC_SESSION_KEYRING) < 0) {
+			perror("keyctl_clear");
+			return 1;
+		}
 	}
-	bootinfo_close(ctx);
 	return 0;
 
-} /* get_passphrase */
+} /* run_benchmark */
 
 /*
  * main program
@@ -250,8 +1074,11 @@ main (int argc, char * const argv[])
 {
 	int c, which, ret;
 	option_routine_t dispatch = NULL;
-	char *outfile = NULL;
-	FILE *outf = stdout;
+	struct key_slot *slot;
+	const char *backend_name = KEY_BACKEND;
+	uint64_t start;
+	unsigned int i;
+	char *cp;
 
 	if (argc < 2) {
 		print_usage();
@@ -279,8 +1106,55 @@ main (int argc, char * const argv[])
 			case 'g':
 				force_generate = true;
 				break;
+			case 'k':
+				setup_bootinfo_key = true;
+				break;
 			case 'o':
-				outfile = strdup(optarg);
+				fprintf(stderr, "passphrase output not supported: the kernel only exports"
+					" encrypted keys in wrapped form\n");
+				return 1;
+				break;
+			case 'v':
+				if (add_key_slot(optarg) == NULL)
+					return 1;
+				break;
+			case 'a':
+				cp = strchr(optarg, ':');
+				if (cp == NULL || cp[1] == '\0') {
+					fprintf(stderr, "Error: --activate requires NAME:DEVICE\n");
+					return 1;
+				}
+				*cp = '\0';
+				slot = add_key_slot(optarg);
+				if (slot == NULL)
+					return 1;
+				slot->device = cp + 1;
+				dispatch = get_passphrase;
+				break;
+			case 'c':
+				dmcrypt_cipher = optarg;
+				break;
+			case 'K':
+				backend_name = optarg;
+				break;
+			case 'r':
+				rotate_mode = ROTATE_STAGE;
+				dispatch = get_passphrase;
+				break;
+			case 'P':
+				rotate_mode = ROTATE_PROMOTE;
+				dispatch = get_passphrase;
+				break;
+			case 't':
+				timing = true;
+				break;
+			case 'B':
+				benchmark_count = strtoul(optarg, &cp, 10);
+				if (*optarg == '\0' || *cp != '\0' || benchmark_count == 0) {
+					fprintf(stderr, "Error: invalid benchmark count: %s\n", optarg);
+					return 1;
+				}
+				timing = true;
 				break;
 			default:
 				fprintf(stderr, "Error: unrecognized option\n");
@@ -295,34 +1169,34 @@ main (int argc, char * const argv[])
 		return 1;
 	}
 
+	if (benchmark_count > 0) {
+		if (dispatch != NULL && dispatch != get_passphrase) {
+			fprintf(stderr, "Error: --benchmark cannot be combined with other operations\n");
+			return 1;
+		}
+		dispatch = run_benchmark;
+	}
+
 	if (dispatch == NULL) {
 		fprintf(stderr, "No operation specified\n");
 		print_usage();
 		return 1;
 	}
 
-	if (outfile != NULL && dispatch == get_passphrase) {
-		int fd = open(outfile, O_CREAT|O_WRONLY|O_TRUNC, S_IRUSR|S_IWUSR);
-		if (fd < 0) {
-			perror(outfile);
-			return 1;
-		}
-		outf = fdopen(fd, "w");
-		if (outf == NULL) {
-			perror(outfile);
-			close(fd);
-			unlink(outfile);
-			return 1;
-		}
+	for (i = 0; i < sizeof(key_backends)/sizeof(key_backends[0]); i++)
+		if (strcmp(backend_name, key_backends[i].name) == 0)
+			backend = &key_backends[i];
+	if (backend == NULL) {
+		fprintf(stderr, "Error: unknown key backend: %s\n", backend_name);
+		return 1;
 	}
 
+	start = timing_start();
 	ret = dispatch();
-	if (outf != stdout) {
-		if (fclose(outf) == EOF) {
-			perror(outfile);
-			ret = 1;
-		}
-	}
+	if (dispatch != run_benchmark)
+		timing_end(TIME_TOTAL, start);
+	if (timing)
+		timing_report();
 
 	return ret;
 
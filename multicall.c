@@ -0,0 +1,96 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * multicall.c
+ *
+ * Entry point for the multi-call binary, which combines
+ * imx-bootinfo, keystoretool, and imx-otp-tool into one
+ * executable for use in an initramfs.  The tool to run is
+ * selected by the name the binary was invoked as (normally
+ * through a symlink), or by the first argument when it is
+ * invoked under its own name.
+ *
+ * Copyright (c) 2022, Matthew Madison
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+#include <stdio.h>
+#include <string.h>
+
+typedef int (*tool_main_t)(int argc, char * const argv[]);
+
+int imx_bootinfo_main(int argc, char * const argv[]);
+int keystoretool_main(int argc, char * const argv[]);
+int imx_otp_tool_main(int argc, char * const argv[]);
+
+static const struct {
+	const char *name;
+	tool_main_t main;
+} tools[] = {
+	{ "imx-bootinfo",	imx_bootinfo_main },
+	{ "keystoretool",	keystoretool_main },
+	{ "imx-otp-tool",	imx_otp_tool_main },
+};
+
+/*
+ * find_tool
+ */
+static tool_main_t
+find_tool (const char *path)
+{
+	const char *name = strrchr(path, '/');
+	unsigned int i;
+
+	name = (name == NULL ? path : name + 1);
+	for (i = 0; i < sizeof(tools)/sizeof(tools[0]); i++)
+		if (strcmp(name, tools[i].name) == 0)
+			return tools[i].main;
+	return NULL;
+
+} /* find_tool */
+
+/*
+ * print_usage
+ */
+static void
+print_usage (void)
+{
+	unsigned int i;
+
+	printf("\nUsage:\n");
+	printf("\t" MULTICALL_NAME " TOOL [ARGS...]\n");
+	printf("or invoke through a link named after the tool.\n");
+	printf("Tools:\n");
+	for (i = 0; i < sizeof(tools)/sizeof(tools[0]); i++)
+		printf(" %s\n", tools[i].name);
+	printf("\n");
+
+} /* print_usage */
+
+/*
+ * main program
+ */
+int
+main (int argc, char * const argv[])
+{
+	tool_main_t tool_main = find_tool(argv[0]);
+
+	if (tool_main == NULL && argc > 1) {
+		if (strcmp(argv[1], "--version") == 0) {
+			printf("%s\n", VERSION);
+			return 0;
+		}
+		tool_main = find_tool(argv[1]);
+		if (tool_main != NULL) {
+			argc -= 1;
+			argv += 1;
+		}
+	}
+	if (tool_main == NULL) {
+		print_usage();
+		return 1;
+	}
+	return tool_main(argc, argv);
+
+} /* main */
@@ -60,6 +60,10 @@ struct otpctx_s;
 typedef struct otpctx_s *otpctx_t;
 
 int otp_context_open(const char *path, bool readonly, otpctx_t *ctxptr);
+int otp_context_open_simulated(const char *path, bool readonly,
+			       unsigned int latency_us, otpctx_t *ctxptr);
+const char *otp_context_soc_id(otpctx_t ctx);
+const char *otp_fuseword_name(otp_fuseword_id_t id);
 void otp_context_close(otpctx_t *ctxptr);
 
 #endif /* opt_h_included */
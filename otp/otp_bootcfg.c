@@ -20,29 +20,17 @@ static const otp_fuseword_id_t bootcfg_fuses[OTP_BOOTCFG_WORD_COUNT] = {
 	OCOTP_BOOT_CFG4,
 };
 
-// Index into above array to identify the fuse word
-#define OTP_BOOTCFG0(name_) [OTP_BOOT_CFG_##name_] = 0,
-#define OTP_BOOTCFG1(name_) [OTP_BOOT_CFG_##name_] = 1,
-static const int bootcfg_fuseword_index[] = {
+// Field descriptor for each of the settings.  These routines
+// work without a context, so they use the i.MX8MM positions.
+#define OTP_BOOTCFG0(name_) [OTP_BOOT_CFG_##name_] = &otp___imx8mm_fields[OTP_FIELD_##name_],
+#define OTP_BOOTCFG1(name_) [OTP_BOOT_CFG_##name_] = &otp___imx8mm_fields[OTP_FIELD_##name_],
+static const otp_field_t *const bootcfg_field[] = {
 	OTP_BOOT_CFG0_GENERIC_FUSES
 	OTP_BOOT_CFG1_GENERIC_FUSES
 };
 #undef OTP_BOOTCFG0
 #undef OTP_BOOTCFG1
 
-// Offset of the field within the fuse word
-static const unsigned int bootcfg_offset[] = {
-	// BOOT_CFG0
-	[OTP_BOOT_CFG_SJC_DISABLE]  = 21,
-	[OTP_BOOT_CFG_SEC_CONFIG]   = 25,
-	[OTP_BOOT_CFG_DIR_BT_DIS]   = 27,
-	[OTP_BOOT_CFG_BT_FUSE_SEL]  = 28,
-	// BOOT_CFG1
-	[OTP_BOOT_CFG_WDOG_ENABLE]  = 10,
-	[OTP_BOOT_CFG_TZASC_ENABLE] = 11,
-	[OTP_BOOT_CFG_WDOG_TIMEOUT] = 16,
-};
-
 static const unsigned int timeouts[] = {
 	[0] = 64,
 	[1] = 32,
@@ -84,27 +72,39 @@ otp_bootcfg_read (otpctx_t ctx, uint32_t *fusewords, size_t sizeinwords)
 int
 otp_bootcfg_update (otpctx_t ctx, uint32_t *newvals, size_t sizeinwords)
 {
-	ssize_t count;
-	uint32_t curvals[OTP_BOOTCFG_WORD_COUNT];
-
 	if (ctx == NULL || newvals == NULL || sizeinwords != OTP_BOOTCFG_WORD_COUNT) {
 		errno = EINVAL;
 		return -1;
 	}
 
-	for (count = 0; count < OTP_BOOTCFG_WORD_COUNT; count += 1)
-		if (otp___fuseword_read(ctx, bootcfg_fuses[count], &curvals[count]) < 0)
-			return -1;
-	for (count = 0; count < OTP_BOOTCFG_WORD_COUNT; count += 1) {
-		if (curvals[count] == newvals[count])
-			continue;
-		if (otp___fuseword_write(ctx, bootcfg_fuses[count], newvals[count]) < 0)
-			return -1;
-	}
-	return 0;
+	return otp___fuseword_write_multi(ctx, bootcfg_fuses, newvals, OTP_BOOTCFG_WORD_COUNT);
 
 } /* otp_bootcfg_update */
 
+/*
+ * bootcfg_word
+ *
+ * Locates the fuse word holding a BOOT_CFGx setting in
+ * the caller's array of BOOT_CFGx fuse words.
+ */
+static uint32_t *
+bootcfg_word (uint32_t *fusewords, size_t sizeinwords, otp_boot_cfg_id_t id)
+{
+	size_t idx;
+
+	if (fusewords == NULL || (unsigned int) id >= OTP_BOOT_CFG_COUNT) {
+		errno = EINVAL;
+		return NULL;
+	}
+	idx = bootcfg_field[id]->word - OCOTP_BOOT_CFG0;
+	if (idx >= sizeinwords) {
+		errno = EINVAL;
+		return NULL;
+	}
+	return &fusewords[idx];
+
+} /* bootcfg_word */
+
 /*
  * otp_bootcfg_bool_get
  *
@@ -115,15 +115,14 @@ int
 otp_bootcfg_bool_get (uint32_t *fusewords, size_t sizeinwords,
 		      otp_boot_cfg_id_t id, bool *value)
 {
-	// XXX - magic 2 here because we're only working with
-	//       BOOT_CFG0 and 1 - XXX
-	if (fusewords == NULL || value == NULL ||
-	    sizeinwords < 2 || id >= OTP_BOOT_CFG_COUNT) {
+	uint32_t *word = bootcfg_word(fusewords, sizeinwords, id);
+
+	if (word == NULL || value == NULL) {
 		errno = EINVAL;
 		return -1;
 	}
 
-	*value = (fusewords[bootcfg_fuseword_index[id]] & (1U << bootcfg_offset[id])) != 0;
+	*value = otp___field_extract(*word, bootcfg_field[id]) != 0;
 	return 0;
 
 } /* otp_bootcfg_bool_get */
@@ -133,14 +132,17 @@ otp_bootcfg_bool_get (uint32_t *fusewords, size_t sizeinwords,
  * otp_bootcfg_wdog_get
  *
  * Extracts the watchdog settings from the
- * BOOT_CFGx fuses.
+ * BOOT_CFGx fuses.  Reports a timeout of zero
+ * for an undefined timeout setting.
  */
 int
 otp_bootcfg_wdog_get (uint32_t *fusewords, size_t sizeinwords,
 		      bool *enabled, unsigned int *timeout_in_seconds)
 {
+	uint32_t *word = bootcfg_word(fusewords, sizeinwords, OTP_BOOT_CFG_WDOG_TIMEOUT);
 	unsigned int tmo;
-	if (timeout_in_seconds == NULL) {
+
+	if (word == NULL || timeout_in_seconds == NULL) {
 		errno = EINVAL;
 		return -1;
 	}
@@ -148,10 +150,11 @@ otp_bootcfg_wdog_get (uint32_t *fusewords, size_t sizeinwords,
 	if (otp_bootcfg_bool_get(fusewords, sizeinwords, OTP_BOOT_CFG_WDOG_ENABLE, enabled) < 0)
 		return -1;
 
-	tmo = fusewords[bootcfg_fuseword_index[OTP_BOOT_CFG_WDOG_ENABLE]] & (3U << bootcfg_offset[OTP_BOOT_CFG_WDOG_ENABLE]);
-	if (tmo >= sizeof(timeouts))
+	tmo = otp___field_extract(*word, &otp___imx8mm_fields[OTP_FIELD_WDOG_TIMEOUT]);
+	if (tmo >= sizeof(timeouts)/sizeof(timeouts[0]))
 		*timeout_in_seconds = 0;
-	*timeout_in_seconds = timeouts[tmo];
+	else
+		*timeout_in_seconds = timeouts[tmo];
 
 	return 0;
 
@@ -166,19 +169,12 @@ int
 otp_bootcfg_bool_set (uint32_t *fusewords, size_t sizeinwords,
 		      otp_boot_cfg_id_t id, bool value)
 {
-	// XXX - magic 2 here because we're only working with
-	//       BOOT_CFG0 and 1 - XXX
-	if (fusewords == NULL || sizeinwords < 2 || id >= OTP_BOOT_CFG_COUNT) {
-		errno = EINVAL;
-		return -1;
-	}
+	uint32_t *word = bootcfg_word(fusewords, sizeinwords, id);
 
-	if (value)
-		fusewords[bootcfg_fuseword_index[id]] |= 1U << bootcfg_offset[id];
-	else
-		fusewords[bootcfg_fuseword_index[id]] &= ~(1U << bootcfg_offset[id]);
+	if (word == NULL)
+		return -1;
 
-	return 0;
+	return otp___field_insert(word, bootcfg_field[id], (value ? 1 : 0));
 
 } /* otp_bootcfg_bool_set */
 
@@ -193,10 +189,14 @@ int
 otp_bootcfg_wdog_set (uint32_t *fusewords, size_t sizeinwords,
 		      bool enabled, unsigned int timeout_in_seconds)
 {
-	unsigned int tmo;
+	uint32_t *word = bootcfg_word(fusewords, sizeinwords, OTP_BOOT_CFG_WDOG_TIMEOUT);
+	unsigned int tmo = 0;
+
+	if (word == NULL)
+		return -1;
 	if (timeout_in_seconds != 0) {
-		for (tmo = 0; tmo < sizeof(timeouts) && timeouts[tmo] != timeout_in_seconds; tmo += 1);
-		if (tmo >= sizeof(timeouts)) {
+		for (tmo = 0; tmo < sizeof(timeouts)/sizeof(timeouts[0]) && timeouts[tmo] != timeout_in_seconds; tmo += 1);
+		if (tmo >= sizeof(timeouts)/sizeof(timeouts[0])) {
 			errno = EINVAL;
 			return -1;
 		}
@@ -205,10 +205,8 @@ otp_bootcfg_wdog_set (uint32_t *fusewords, size_t sizeinwords,
 	if (otp_bootcfg_bool_set(fusewords, sizeinwords, OTP_BOOT_CFG_WDOG_ENABLE, enabled) < 0)
 		return -1;
 
-	if (timeout_in_seconds != 0) {
-		fusewords[bootcfg_fuseword_index[OTP_BOOT_CFG_WDOG_ENABLE]] &= ~(3U << bootcfg_offset[OTP_BOOT_CFG_WDOG_ENABLE]);
-		fusewords[bootcfg_fuseword_index[OTP_BOOT_CFG_WDOG_ENABLE]] |=  (tmo << bootcfg_offset[OTP_BOOT_CFG_WDOG_ENABLE]);
-	}
+	if (timeout_in_seconds != 0)
+		return otp___field_insert(word, &otp___imx8mm_fields[OTP_FIELD_WDOG_TIMEOUT], tmo);
 
 	return 0;
 
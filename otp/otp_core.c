@@ -17,11 +17,47 @@
 
 #define DEFAULT_PATH "/sys/bus/nvmem/devices/imx-ocotp0/nvmem"
 
+/*
+ * Each fuse word read through the nvmem interface is a
+ * separate OCOTP transaction in the driver, so the fuse
+ * words are read all at once into a shadow copy, the first
+ * time one is needed.  Writes invalidate the shadow copy,
+ * since programmed fuses do not necessarily read back with
+ * the value written.
+ */
 struct otpctx_s {
 	int fd;
+	const struct fuse_map *map;
+	uint32_t *shadow;
+	size_t shadow_size;
+	bool shadow_valid;
+	bool simulated;
+	unsigned int latency_us;
 };
 
-static off_t fuseword_offsets[] = {
+/*
+ * One entry in a write plan: a fuse word that
+ * needs programming.
+ */
+struct write_entry {
+	off_t offset;
+	uint32_t value;
+};
+
+/*
+ * Fuse map for each supported SoC, giving the nvmem
+ * offset of each fuse word and the position of each
+ * field.  Only SoCs whose offsets and field positions
+ * have been checked against the reference manual are
+ * listed; any other SoC fails to open with EFAULT.
+ */
+struct fuse_map {
+	const char *soc_id;
+	const off_t *offsets;
+	const otp_field_t *fields;
+};
+
+static const off_t imx8mm_fuseword_offsets[OTP___FUSEWORD_COUNT] = {
 	[OCOTP_LOCK]		= 0x0,
 	[OCOTP_TESTER0]		= 0x4,
 	[OCOTP_TESTER1]		= 0x8,
@@ -55,31 +91,78 @@ static off_t fuseword_offsets[] = {
 	[OCOTP_GP21]		= 0xec,
 };
 
+static const struct fuse_map fuse_maps[] = {
+	{ "i.MX8MM",	imx8mm_fuseword_offsets,	otp___imx8mm_fields },
+};
+
+#define OTP_FUSEWORD(x_) [OCOTP_##x_] = #x_,
+static const char *fuseword_names[] = {
+	OTP_FUSEWORDS
+};
+#undef OTP_FUSEWORD
+
 /*
- * is_compatible
+ * find_fuse_map
  *
- * Sanity checks the SoC ID to make sure it's an i.MX8M Mini,
- * since the fuse definitions here are only for that SoC.
+ * Looks up the fuse map for the SoC we are running on,
+ * by its SoC ID.  Returns NULL if the SoC is not supported.
  */
-static bool
-is_compatible (void)
+static const struct fuse_map *
+find_fuse_map (void)
 {
 	int fd;
 	char socid[32];
 	ssize_t n;
+	unsigned int i;
 
 	fd = open("/sys/devices/soc0/soc_id", O_RDONLY);
 	if (fd < 0)
-		return false;
+		return NULL;
 	n = read(fd, socid, sizeof(socid));
 	close(fd);
 	if (n <= 0 || n >= (ssize_t) sizeof(socid))
-		return false;
+		return NULL;
 	// Change terminating \n to \0
 	socid[n-1] = '\0';
-	return strcmp(socid, "i.MX8MM") == 0;
+	for (i = 0; i < sizeof(fuse_maps)/sizeof(fuse_maps[0]); i++)
+		if (strcmp(socid, fuse_maps[i].soc_id) == 0)
+			return &fuse_maps[i];
+	return NULL;
+
+} /* find_fuse_map */
+
+/*
+ * context_setup
+ *
+ * Common setup for real and simulated contexts.
+ */
+static otpctx_t
+context_setup (const char *path, bool readonly, const struct fuse_map *map)
+{
+	otpctx_t ctx;
+	otp_fuseword_id_t id;
 
-} /* is_compatible */
+	ctx = calloc(1, sizeof(struct otpctx_s));
+	if (ctx == NULL)
+		return NULL;
+	ctx->map = map;
+	for (id = 0; id < OTP___FUSEWORD_COUNT; id++)
+		if ((size_t) map->offsets[id] + sizeof(uint32_t) > ctx->shadow_size)
+			ctx->shadow_size = map->offsets[id] + sizeof(uint32_t);
+	ctx->shadow = malloc(ctx->shadow_size);
+	if (ctx->shadow == NULL) {
+		free(ctx);
+		return NULL;
+	}
+	ctx->fd = open(path, (readonly ? O_RDONLY : O_RDWR) | O_CLOEXEC);
+	if (ctx->fd < 0) {
+		free(ctx->shadow);
+		free(ctx);
+		return NULL;
+	}
+	return ctx;
+
+} /* context_setup */
 
 /*
  * otp_context_open
@@ -90,30 +173,93 @@ int
 otp_context_open (const char *path, bool readonly, otpctx_t *ctxptr)
 {
 	otpctx_t ctx;
+	const struct fuse_map *map;
 
 	if (ctxptr == NULL) {
 		errno = EINVAL;
 		return -1;
 	}
 
-	if (!is_compatible()) {
+	map = find_fuse_map();
+	if (map == NULL) {
 		errno = EFAULT;
 		return -1;
 	}
 
-	ctx = calloc(1, sizeof(struct otpctx_s));
+	ctx = context_setup((path == NULL ? DEFAULT_PATH : path), readonly, map);
 	if (ctx == NULL)
 		return -1;
-	ctx->fd = open((path == NULL ? DEFAULT_PATH : path),
-		       (readonly ? O_RDONLY : O_RDWR));
-	if (ctx->fd < 0) {
-		free(ctx);
+	*ctxptr = ctx;
+	return 0;
+
+} /* otp_context_open */
+
+/*
+ * otp_context_open_simulated
+ *
+ * Set up a context for working with a simulated fuse
+ * box, backed by a file holding an image of the fuse
+ * map.  Writes to the image follow the rules for
+ * programming real fuses, with each fuse word taking
+ * latency_us microseconds to program.  A missing or
+ * short image is extended with zeros (unblown fuses)
+ * unless opened read-only.  The simulated fuse box uses
+ * the fuse map of the first supported SoC (i.MX8MM).
+ *
+ * Like the imx-ocotp driver, the simulated fuse box
+ * rejects writes of more than one fuse word with EINVAL.
+ */
+int
+otp_context_open_simulated (const char *path, bool readonly,
+			    unsigned int latency_us, otpctx_t *ctxptr)
+{
+	otpctx_t ctx;
+	struct stat st;
+	int fd;
+
+	if (path == NULL || ctxptr == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (!readonly) {
+		fd = open(path, O_RDWR|O_CREAT|O_CLOEXEC, 0644);
+		if (fd < 0)
+			return -1;
+		close(fd);
+	}
+	ctx = context_setup(path, readonly, &fuse_maps[0]);
+	if (ctx == NULL)
 		return -1;
+	if (!readonly) {
+		if (fstat(ctx->fd, &st) < 0 ||
+		    ((size_t) st.st_size < ctx->shadow_size &&
+		     ftruncate(ctx->fd, ctx->shadow_size) < 0)) {
+			otp_context_close(&ctx);
+			return -1;
+		}
 	}
+	ctx->simulated = true;
+	ctx->latency_us = latency_us;
 	*ctxptr = ctx;
 	return 0;
 
-} /* otp_context_open */
+} /* otp_context_open_simulated */
+
+/*
+ * otp_context_soc_id
+ *
+ * Returns the SoC ID whose fuse map the context uses.
+ */
+const char *
+otp_context_soc_id (otpctx_t ctx)
+{
+	if (ctx == NULL) {
+		errno = EINVAL;
+		return NULL;
+	}
+	return ctx->map->soc_id;
+
+} /* otp_context_soc_id */
 
 /*
  * otp_context_close
@@ -126,27 +272,117 @@ otp_context_close (otpctx_t *ctxptr)
 	if (ctxptr == NULL || *ctxptr == NULL)
 		return;
 	close((*ctxptr)->fd);
+	free((*ctxptr)->shadow);
 	free(*ctxptr);
 	*ctxptr = NULL;
 
 } /* otp_context_close */
 
+/*
+ * otp_fuseword_name
+ *
+ * Returns the name of a fuse word, or NULL for an
+ * invalid fuse word ID.
+ */
+const char *
+otp_fuseword_name (otp_fuseword_id_t id)
+{
+	if (id >= OTP___FUSEWORD_COUNT) {
+		errno = EINVAL;
+		return NULL;
+	}
+	return fuseword_names[id];
+
+} /* otp_fuseword_name */
+
 // --- Internal functions below this point ---
 
+/*
+ * shadow_load
+ *
+ * Fills in the shadow copy of the fuse words,
+ * if needed, with a single read.
+ */
+static int
+shadow_load (otpctx_t ctx)
+{
+	ssize_t n;
+
+	if (ctx->shadow_valid)
+		return 0;
+	n = pread(ctx->fd, ctx->shadow, ctx->shadow_size, 0);
+	if (n < 0)
+		return -1;
+	if ((size_t) n != ctx->shadow_size) {
+		errno = EIO;
+		return -1;
+	}
+	ctx->shadow_valid = true;
+	return 0;
+
+} /* shadow_load */
+
+/*
+ * otp___shadow_reload
+ *
+ * Discards the shadow copy of the fuse words and reads
+ * them again, for callers that need to see changes made
+ * through other contexts (or processes) since it was read.
+ */
+int INTERNAL
+otp___shadow_reload (otpctx_t ctx)
+{
+	if (ctx == NULL || ctx->fd < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	ctx->shadow_valid = false;
+	return shadow_load(ctx);
+
+} /* otp___shadow_reload */
+
+/*
+ * nvmem_pwrite
+ *
+ * Writes fuse words to the nvmem device, or to
+ * the image for a simulated context.
+ */
+static ssize_t
+nvmem_pwrite (otpctx_t ctx, const void *buf, size_t len, off_t offset)
+{
+	if (ctx->simulated)
+		return otp___sim_pwrite(ctx->fd, ctx->map->offsets, buf, len, offset,
+					ctx->latency_us);
+	return pwrite(ctx->fd, buf, len, offset);
+
+} /* nvmem_pwrite */
+
 /*
  * otp___fuseword_offset
  *
  * Returns an offset into the nvmem for a fuse word.
  */
 off_t INTERNAL
-otp___fuseword_offset (otp_fuseword_id_t id)
+otp___fuseword_offset (otpctx_t ctx, otp_fuseword_id_t id)
 {
-	if (id >= OTP___FUSEWORD_COUNT)
+	if (ctx == NULL || id >= OTP___FUSEWORD_COUNT)
 		return (off_t) (-1);
-	return fuseword_offsets[id];
+	return ctx->map->offsets[id];
 
 } /* otp___fuseword_offset */
 
+/*
+ * otp___context_fields
+ *
+ * Returns the field table for the context's SoC.
+ */
+const otp_field_t INTERNAL *
+otp___context_fields (otpctx_t ctx)
+{
+	return ctx->map->fields;
+
+} /* otp___context_fields */
+
 /*
  * otp___fuseword_read
  *
@@ -159,10 +395,9 @@ otp___fuseword_read (otpctx_t ctx, otp_fuseword_id_t id, uint32_t *val)
 		errno = EINVAL;
 		return -1;
 	}
-	if (lseek(ctx->fd, fuseword_offsets[id], SEEK_SET) < 0)
-		return -1;
-	if (read(ctx->fd, val, sizeof(uint32_t)) != sizeof(uint32_t))
+	if (shadow_load(ctx) < 0)
 		return -1;
+	*val = ctx->shadow[ctx->map->offsets[id] / sizeof(uint32_t)];
 	return 0;
 
 } /* otp___fuseword_read */
@@ -181,15 +416,81 @@ otp___fuseword_write (otpctx_t ctx, otp_fuseword_id_t id, uint32_t newval)
 		errno = EINVAL;
 		return -1;
 	}
-	if (lseek(ctx->fd, fuseword_offsets[id], SEEK_SET) < 0)
-		return -1;
-	if (write(ctx->fd, &newval, sizeof(uint32_t)) != sizeof(uint32_t))
+	ctx->shadow_valid = false;
+	if (nvmem_pwrite(ctx, &newval, sizeof(uint32_t), ctx->map->offsets[id]) != sizeof(uint32_t))
 		return -1;
 
 	return 0;
 
 } /* otp___fuseword_write */
 
+/*
+ * otp___fuseword_write_multi
+ *
+ * Writes a set of fuse words, skipping any whose current
+ * value already matches the desired value.  The words that
+ * need programming are sorted by offset and programmed one
+ * at a time, since the imx-ocotp driver rejects any write
+ * that is not exactly one word.  The programmed words are
+ * then read back to verify them.
+ *
+ * Returns: 0 on success, -1 on error (errno set; EIO
+ * if verification failed).
+ */
+int INTERNAL
+otp___fuseword_write_multi (otpctx_t ctx, const otp_fuseword_id_t *ids,
+			    const uint32_t *newvals, size_t count)
+{
+	struct write_entry plan[OTP___FUSEWORD_COUNT], entry;
+	size_t i, j, planned;
+
+	if (ctx == NULL || ctx->fd < 0 || ids == NULL || newvals == NULL ||
+	    count > OTP___FUSEWORD_COUNT) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (shadow_load(ctx) < 0)
+		return -1;
+
+	for (i = 0, planned = 0; i < count; i++) {
+		if (ids[i] >= OTP___FUSEWORD_COUNT) {
+			errno = EINVAL;
+			return -1;
+		}
+		entry.offset = ctx->map->offsets[ids[i]];
+		entry.value = newvals[i];
+		if (ctx->shadow[entry.offset / sizeof(uint32_t)] == entry.value)
+			continue;
+		for (j = planned; j > 0 && plan[j-1].offset > entry.offset; j--)
+			plan[j] = plan[j-1];
+		if (j > 0 && plan[j-1].offset == entry.offset) {
+			errno = EINVAL;
+			return -1;
+		}
+		plan[j] = entry;
+		planned += 1;
+	}
+	if (planned == 0)
+		return 0;
+
+	ctx->shadow_valid = false;
+	for (i = 0; i < planned; i++)
+		if (nvmem_pwrite(ctx, &plan[i].value, sizeof(uint32_t),
+				 plan[i].offset) != sizeof(uint32_t))
+			return -1;
+
+	if (shadow_load(ctx) < 0)
+		return -1;
+	for (i = 0; i < planned; i++) {
+		if (ctx->shadow[plan[i].offset / sizeof(uint32_t)] != plan[i].value) {
+			errno = EIO;
+			return -1;
+		}
+	}
+	return 0;
+
+} /* otp___fuseword_write_multi */
+
 /*
  * otp___fuseword_update
  *
@@ -201,21 +502,10 @@ otp___fuseword_update (otpctx_t ctx, otp_fuseword_id_t id, uint32_t newval)
 {
 	uint32_t curval;
 
-	if (ctx == NULL || ctx->fd < 0 || id >= OTP___FUSEWORD_COUNT) {
-		errno = EINVAL;
-		return -1;
-	}
-	if (lseek(ctx->fd, fuseword_offsets[id], SEEK_SET) < 0)
-		return -1;
-	if (read(ctx->fd, &curval, sizeof(uint32_t)) != sizeof(uint32_t))
+	if (otp___fuseword_read(ctx, id, &curval) < 0)
 		return -1;
 	if (curval == newval)
 		return 0;
-	if (lseek(ctx->fd, fuseword_offsets[id], SEEK_SET) < 0)
-		return -1;
-	if (write(ctx->fd, &newval, sizeof(uint32_t)) != sizeof(uint32_t))
-		return -1;
-
-	return 0;
+	return otp___fuseword_write(ctx, id, newval);
 
 } /* otp___fuseword_update */
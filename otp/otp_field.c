@@ -0,0 +1,152 @@
+/*
+ * otp_field.c
+ *
+ * Routines for reading and setting named bitfields.
+ * The field positions come from the fuse map of the
+ * context's SoC; the i.MX8M Mini's table is generated
+ * from OTP_FIELDS.  The generic routines work on an
+ * array of all of the fuse words, indexed by fuse word
+ * ID, such as a fuse plan's word arrays.
+ *
+ * Copyright (c) 2022, Matthew Madison.
+ */
+
+#include <strings.h>
+#include "otp_internal.h"
+#include "otp_field.h"
+
+#define OTP_FIELD(name_, word_, shift_, width_) \
+	[OTP_FIELD_##name_] = { #name_, OCOTP_##word_, shift_, width_ },
+const otp_field_t INTERNAL otp___imx8mm_fields[OTP_FIELD___COUNT] = {
+	OTP_FIELDS
+};
+#undef OTP_FIELD
+
+/*
+ * field_mask
+ *
+ * Returns the mask for a field's value, before
+ * shifting into position.
+ */
+static inline uint32_t
+field_mask (const otp_field_t *field)
+{
+	return (field->width >= 32 ? 0xFFFFFFFFU : (1U << field->width) - 1);
+
+} /* field_mask */
+
+/*
+ * otp___field_extract
+ *
+ * Extracts a field's value from its fuse word.
+ */
+uint32_t INTERNAL
+otp___field_extract (uint32_t word, const otp_field_t *field)
+{
+	return (word >> field->shift) & field_mask(field);
+
+} /* otp___field_extract */
+
+/*
+ * otp___field_insert
+ *
+ * Sets a field's value in its fuse word.  The value
+ * must fit in the field.
+ */
+int INTERNAL
+otp___field_insert (uint32_t *word, const otp_field_t *field, uint32_t value)
+{
+	uint32_t mask = field_mask(field);
+
+	if ((value & ~mask) != 0) {
+		errno = ERANGE;
+		return -1;
+	}
+	*word = (*word & ~(mask << field->shift)) | (value << field->shift);
+	return 0;
+
+} /* otp___field_insert */
+
+/*
+ * otp_field
+ *
+ * Returns the descriptor for a field on the context's
+ * SoC, or NULL for an invalid field ID.
+ */
+const otp_field_t *
+otp_field (otpctx_t ctx, otp_field_id_t id)
+{
+	if (ctx == NULL || (unsigned int) id >= OTP_FIELD_COUNT) {
+		errno = EINVAL;
+		return NULL;
+	}
+	return &otp___context_fields(ctx)[id];
+
+} /* otp_field */
+
+/*
+ * otp_field_lookup
+ *
+ * Finds a field by name (case-insensitive).  Field
+ * names are the same for every SoC.
+ */
+int
+otp_field_lookup (const char *name, otp_field_id_t *id)
+{
+	unsigned int i;
+
+	if (name == NULL || id == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	for (i = 0; i < OTP_FIELD_COUNT; i++) {
+		if (strcasecmp(name, otp___imx8mm_fields[i].name) == 0) {
+			*id = (otp_field_id_t) i;
+			return 0;
+		}
+	}
+	errno = ENOENT;
+	return -1;
+
+} /* otp_field_lookup */
+
+/*
+ * otp_field_get
+ *
+ * Extracts a field's value from an array of all
+ * of the fuse words.
+ */
+int
+otp_field_get (otpctx_t ctx, const uint32_t *fusewords, otp_field_id_t id, uint32_t *value)
+{
+	const otp_field_t *field = otp_field(ctx, id);
+
+	if (field == NULL || fusewords == NULL || value == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	*value = otp___field_extract(fusewords[field->word], field);
+	return 0;
+
+} /* otp_field_get */
+
+/*
+ * otp_field_set
+ *
+ * Sets a field's value in an array of all of the fuse
+ * words.  Like the other setters, this just does the bit
+ * manipulation; clearing bits of a blown fuse is caught
+ * when the change is planned.
+ */
+int
+otp_field_set (otpctx_t ctx, uint32_t *fusewords, otp_field_id_t id, uint32_t value)
+{
+	const otp_field_t *field = otp_field(ctx, id);
+
+	if (field == NULL || fusewords == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	return otp___field_insert(&fusewords[field->word], field, value);
+
+} /* otp_field_set */
@@ -0,0 +1,64 @@
+#ifndef otp_field_h_included
+#define otp_field_h_included
+/*
+ * otp_field.h
+ *
+ * Definitions for named bitfields within the fuse words.
+ *
+ * Copyright (c) 2022, Matthew Madison.
+ */
+#include "otp.h"
+#include <stdint.h>
+
+/*
+ * Each field is defined by the fuse word that holds it,
+ * and its bit offset and width within that word.  The
+ * positions here are those of the i.MX8M Mini; each SoC's
+ * fuse map has its own field table, so a SoC that places
+ * fields differently gets a table of its own.
+ */
+#undef OTP_FIELD
+#define OTP_FIELDS \
+	OTP_FIELD(LOCK_TESTER,		LOCK,		 0,  2) \
+	OTP_FIELD(LOCK_BOOT_CFG,	LOCK,		 2,  2) \
+	OTP_FIELD(LOCK_SRK,		LOCK,		 9,  1) \
+	OTP_FIELD(LOCK_SJC_RESP,	LOCK,		10,  1) \
+	OTP_FIELD(LOCK_USB_ID,		LOCK,		12,  2) \
+	OTP_FIELD(LOCK_MAC_ADDR,	LOCK,		14,  2) \
+	OTP_FIELD(LOCK_MANUFACTURE_KEY,	LOCK,		16,  1) \
+	OTP_FIELD(LOCK_GP1,		LOCK,		20,  2) \
+	OTP_FIELD(LOCK_GP2,		LOCK,		22,  2) \
+	OTP_FIELD(LOCK_GP5,		LOCK,		24,  2) \
+	OTP_FIELD(SJC_DISABLE,		BOOT_CFG0,	21,  1) \
+	OTP_FIELD(SEC_CONFIG,		BOOT_CFG0,	25,  1) \
+	OTP_FIELD(DIR_BT_DIS,		BOOT_CFG0,	27,  1) \
+	OTP_FIELD(BT_FUSE_SEL,		BOOT_CFG0,	28,  1) \
+	OTP_FIELD(WDOG_ENABLE,		BOOT_CFG1,	10,  1) \
+	OTP_FIELD(TZASC_ENABLE,		BOOT_CFG1,	11,  1) \
+	OTP_FIELD(WDOG_TIMEOUT,		BOOT_CFG1,	16,  3) \
+	OTP_FIELD(GP10,			GP10,		 0, 32) \
+	OTP_FIELD(GP11,			GP11,		 0, 32) \
+	OTP_FIELD(GP20,			GP20,		 0, 32) \
+	OTP_FIELD(GP21,			GP21,		 0, 32)
+
+#define OTP_FIELD(name_, word_, shift_, width_) OTP_FIELD_##name_,
+typedef enum {
+	OTP_FIELDS
+	OTP_FIELD___COUNT
+} otp_field_id_t;
+#undef OTP_FIELD
+#define OTP_FIELD_COUNT ((unsigned int) OTP_FIELD___COUNT)
+
+typedef struct {
+	const char *name;
+	otp_fuseword_id_t word;
+	unsigned int shift;
+	unsigned int width;
+} otp_field_t;
+
+const otp_field_t *otp_field(otpctx_t ctx, otp_field_id_t id);
+int otp_field_lookup(const char *name, otp_field_id_t *id);
+int otp_field_get(otpctx_t ctx, const uint32_t *fusewords, otp_field_id_t id, uint32_t *value);
+int otp_field_set(otpctx_t ctx, uint32_t *fusewords, otp_field_id_t id, uint32_t value);
+
+#endif /* otp_field_h_included */
@@ -9,11 +9,21 @@
  */
 
 #include "otp.h"
+#include "otp_field.h"
 
 #define INTERNAL __attribute__((visibility("hidden")))
-off_t INTERNAL otp___fuseword_offset(otp_fuseword_id_t id);
+int INTERNAL otp___shadow_reload(otpctx_t ctx);
+off_t INTERNAL otp___fuseword_offset(otpctx_t ctx, otp_fuseword_id_t id);
 int INTERNAL otp___fuseword_read(otpctx_t ctx, otp_fuseword_id_t id, uint32_t *val);
 int INTERNAL otp___fuseword_write(otpctx_t ctx, otp_fuseword_id_t id, uint32_t newval);
 int INTERNAL otp___fuseword_update(otpctx_t ctx, otp_fuseword_id_t id, uint32_t newval);
+int INTERNAL otp___fuseword_write_multi(otpctx_t ctx, const otp_fuseword_id_t *ids,
+					const uint32_t *newvals, size_t count);
+extern const otp_field_t INTERNAL otp___imx8mm_fields[OTP_FIELD___COUNT];
+const otp_field_t INTERNAL *otp___context_fields(otpctx_t ctx);
+uint32_t INTERNAL otp___field_extract(uint32_t word, const otp_field_t *field);
+int INTERNAL otp___field_insert(uint32_t *word, const otp_field_t *field, uint32_t value);
+ssize_t INTERNAL otp___sim_pwrite(int fd, const off_t *offsets, const void *buf,
+				  size_t len, off_t offset, unsigned int latency_us);
 
 #endif /* opt_internal_h_included */
@@ -16,22 +16,11 @@
 #include "otp_internal.h"
 #include "otp_lock.h"
 
-static unsigned int lock_offsets[] = {
-	[OTP_LOCK_TESTER] = 0,
-	[OTP_LOCK_BOOT_CFG] = 2,
-	[OTP_LOCK_SRK] = 9,
-	[OTP_LOCK_SJC_RESP] = 10,
-	[OTP_LOCK_USB_ID] = 12,
-	[OTP_LOCK_MAC_ADDR] = 14,
-	[OTP_LOCK_MANUFACTURE_KEY] = 16,
-	[OTP_LOCK_GP1] = 20,
-	[OTP_LOCK_GP2] = 22,
-	[OTP_LOCK_GP5] = 24,
-};
-
-#define OTP_LOCK_1BIT(name_) [OTP_LOCK_##name_] = true,
-#define OTP_LOCK_2BIT(name_) [OTP_LOCK_##name_] = false,
-static bool lock_is_1bit[] = {
+// Field descriptor for each of the locks.  These routines
+// work without a context, so they use the i.MX8MM positions.
+#define OTP_LOCK_1BIT(name_) [OTP_LOCK_##name_] = &otp___imx8mm_fields[OTP_FIELD_LOCK_##name_],
+#define OTP_LOCK_2BIT(name_) [OTP_LOCK_##name_] = &otp___imx8mm_fields[OTP_FIELD_LOCK_##name_],
+static const otp_field_t *const lock_field[] = {
 	OTP_LOCKS_2BIT
 	OTP_LOCKS_1BIT
 };
@@ -88,7 +77,7 @@ otp_locks_update (otpctx_t ctx, uint32_t lockword)
 const char *
 otp_lock_name (otp_lock_id_t id)
 {
-	if ((unsigned int) id >= sizeof(locknames)) {
+	if ((unsigned int) id >= OTP_LOCK_COUNT) {
 		errno = EINVAL;
 		return NULL;
 	}
@@ -116,10 +105,10 @@ otp_lockstate_get (uint32_t lockword, otp_lock_id_t id, otp_lockstate_t *locksta
 		return -1;
 	}
 
-	if (lock_is_1bit[id])
-		*lockstate = ((lockword >> lock_offsets[id]) & 1) ? OTP_LOCKSTATE_LOCKED : OTP_LOCKSTATE_UNLOCKED;
+	if (lock_field[id]->width == 1)
+		*lockstate = otp___field_extract(lockword, lock_field[id]) ? OTP_LOCKSTATE_LOCKED : OTP_LOCKSTATE_UNLOCKED;
 	else
-		*lockstate = twobit_states[(lockword >> lock_offsets[id]) & 3];
+		*lockstate = twobit_states[otp___field_extract(lockword, lock_field[id])];
 	return 0;
 
 } /* otp_lockstate_get */
@@ -135,43 +124,36 @@ otp_lockstate_get (uint32_t lockword, otp_lock_id_t id, otp_lockstate_t *locksta
 int
 otp_lockstate_set (otp_lock_id_t id, otp_lockstate_t newstate, uint32_t *lockword)
 {
+	uint32_t value;
 
 	if (lockword == NULL || (unsigned int) id >= OTP_LOCK_COUNT ||
 	    (unsigned int) newstate >= OTP_LOCKSTATE_COUNT) {
 		errno = EINVAL;
 		return -1;
 	}
-	if (lock_is_1bit[id]) {
-		uint32_t mask = 1U << lock_offsets[id];
+	if (lock_field[id]->width == 1) {
 		if (newstate == OTP_LOCKSTATE_UNLOCKED)
-			*lockword &= ~mask;
+			value = 0;
 		else if (newstate == OTP_LOCKSTATE_LOCKED)
-			*lockword |= mask;
+			value = 1;
 		else {
 			errno = EINVAL;
 			return -1;
 		}
 	} else {
-		uint32_t off_mask, on_mask;
-		if (newstate == OTP_LOCKSTATE_UNLOCKED) {
-			off_mask = (3U << lock_offsets[id]);
-			on_mask = 0;
-		} else if (newstate == OTP_LOCKSTATE_O_PROTECT) {
-			off_mask = (1U << lock_offsets[id]);
-			on_mask =  (2U << lock_offsets[id]);
-		} else if (newstate == OTP_LOCKSTATE_W_PROTECT) {
-			off_mask = (2U << lock_offsets[id]);
-			on_mask =  (1U << lock_offsets[id]);
-		} else if (newstate == OTP_LOCKSTATE_OW_PROTECT) {
-			off_mask = 0;
-			on_mask =  (3U << lock_offsets[id]);
-		} else {
+		if (newstate == OTP_LOCKSTATE_UNLOCKED)
+			value = 0;
+		else if (newstate == OTP_LOCKSTATE_W_PROTECT)
+			value = 1;
+		else if (newstate == OTP_LOCKSTATE_O_PROTECT)
+			value = 2;
+		else if (newstate == OTP_LOCKSTATE_OW_PROTECT)
+			value = 3;
+		else {
 			errno = EINVAL;
 			return -1;
 		}
-		*lockword &= ~off_mask;
-		*lockword |= on_mask;
 	}
-	return 0;
+	return otp___field_insert(lockword, lock_field[id], value);
 
 } /* otp_lockstate_set */
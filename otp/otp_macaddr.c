@@ -8,6 +8,20 @@
 #include <string.h>
 #include "otp_internal.h"
 #include "otp_macaddr.h"
+#include "otp_plan.h"
+
+/*
+ * mac_to_fusewords
+ * Converts a MAC address to its MAC0/1 fuse values.
+ */
+static void
+mac_to_fusewords (const uint8_t macaddr[6], uint32_t *mac0, uint32_t *mac1)
+{
+	*mac1 = (macaddr[0] << 8) | macaddr[1];
+	*mac0 = ((uint32_t) macaddr[2] << 24) | (macaddr[3] << 16) |
+		(macaddr[4] << 8) | macaddr[5];
+
+} /* mac_to_fusewords */
 
 /*
  * otp_macaddr_read
@@ -60,9 +74,7 @@ otp_macaddr_write (otpctx_t ctx, uint8_t newaddr[6])
 	if (memcmp(curaddr, newaddr, sizeof(curaddr)) == 0)
 		return 0;
 
-	mac1 = (newaddr[0] << 8) | newaddr[1];
-	mac0 = (newaddr[2] << 24) | (newaddr[3] << 16) |
-		(newaddr[4] << 8) | newaddr[5];
+	mac_to_fusewords(newaddr, &mac0, &mac1);
 
  	ret = otp___fuseword_write(ctx, OCOTP_MAC_ADDR0, mac0);
 	if (ret == 0)
@@ -71,3 +83,31 @@ otp_macaddr_write (otpctx_t ctx, uint8_t newaddr[6])
 	return ret;
 
 } /* otp_macaddr_write */
+
+/*
+ * otp_macaddr_plan
+ * Adds the MAC0/1 fuses to a fuse plan.  As with
+ * otp_macaddr_write, the fuses must currently be
+ * zero (or already hold the same address).
+ */
+int
+otp_macaddr_plan (otp_plan_t *plan, uint8_t newaddr[6])
+{
+	uint32_t mac0, mac1;
+
+	if (plan == NULL || newaddr == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	mac_to_fusewords(newaddr, &mac0, &mac1);
+	if ((plan->current[OCOTP_MAC_ADDR0] != 0 || plan->current[OCOTP_MAC_ADDR1] != 0) &&
+	    (plan->current[OCOTP_MAC_ADDR0] != mac0 || plan->current[OCOTP_MAC_ADDR1] != mac1)) {
+		errno = EALREADY;
+		return -1;
+	}
+	if (otp_plan_set(plan, OCOTP_MAC_ADDR0, mac0) < 0 ||
+	    otp_plan_set(plan, OCOTP_MAC_ADDR1, mac1) < 0)
+		return -1;
+	return 0;
+
+} /* otp_macaddr_plan */
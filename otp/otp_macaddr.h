@@ -8,7 +8,9 @@
  * Copyright (c) 2022, Matthew Madison.
  */
 #include <stdint.h>
+#include "otp_plan.h"
 
 int otp_macaddr_read(otpctx_t ctx, uint8_t macaddr[6]);
 int otp_macaddr_write(otpctx_t ctx, uint8_t macaddr[6]);
+int otp_macaddr_plan(otp_plan_t *plan, uint8_t macaddr[6]);
 #endif /* otp_macaddr_h_included */
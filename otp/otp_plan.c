@@ -0,0 +1,185 @@
+/*
+ * otp_plan.c
+ *
+ * Routines for planning a set of fuse changes against
+ * a single read of the fuse map, and applying them with
+ * the minimum number of writes.
+ *
+ * Copyright (c) 2022, Matthew Madison.
+ */
+
+#include <string.h>
+#include "otp_internal.h"
+#include "otp_plan.h"
+
+/*
+ * otp_plan_init
+ *
+ * Starts a plan from the current state of the fuses,
+ * with no changes.  The fuses are read afresh, so that
+ * changes made through other contexts are seen.
+ */
+int
+otp_plan_init (otpctx_t ctx, otp_plan_t *plan)
+{
+	otp_fuseword_id_t id;
+
+	if (ctx == NULL || plan == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (otp___shadow_reload(ctx) < 0)
+		return -1;
+	for (id = 0; id < OTP___FUSEWORD_COUNT; id++)
+		if (otp___fuseword_read(ctx, id, &plan->current[id]) < 0)
+			return -1;
+	memcpy(plan->desired, plan->current, sizeof(plan->desired));
+	plan->fields = otp___context_fields(ctx);
+	return 0;
+
+} /* otp_plan_init */
+
+/*
+ * otp_plan_get
+ *
+ * Returns the value a fuse word will have once
+ * the plan is applied.
+ */
+int
+otp_plan_get (otp_plan_t *plan, otp_fuseword_id_t id, uint32_t *value)
+{
+	if (plan == NULL || value == NULL || id >= OTP___FUSEWORD_COUNT) {
+		errno = EINVAL;
+		return -1;
+	}
+	*value = plan->desired[id];
+	return 0;
+
+} /* otp_plan_get */
+
+/*
+ * otp_plan_set
+ *
+ * Sets the value a fuse word should have once the plan
+ * is applied.  Since fuses can only be blown, not reset,
+ * the new value must include all of the bits already set
+ * in the fuse word.
+ */
+int
+otp_plan_set (otp_plan_t *plan, otp_fuseword_id_t id, uint32_t value)
+{
+	if (plan == NULL || id >= OTP___FUSEWORD_COUNT ||
+	    (plan->current[id] & ~value) != 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	plan->desired[id] = value;
+	return 0;
+
+} /* otp_plan_set */
+
+/*
+ * otp_plan_field_set
+ *
+ * Sets the value a field should have once the plan
+ * is applied, with the same check as otp_plan_set.
+ */
+int
+otp_plan_field_set (otp_plan_t *plan, otp_field_id_t id, uint32_t value)
+{
+	const otp_field_t *field;
+	uint32_t word;
+
+	if (plan == NULL || plan->fields == NULL || (unsigned int) id >= OTP_FIELD_COUNT) {
+		errno = EINVAL;
+		return -1;
+	}
+	field = &plan->fields[id];
+	word = plan->desired[field->word];
+	if (otp___field_insert(&word, field, value) < 0)
+		return -1;
+	return otp_plan_set(plan, field->word, word);
+
+} /* otp_plan_field_set */
+
+/*
+ * otp_plan_changed
+ *
+ * Checks whether the plan programs a fuse word.
+ */
+bool
+otp_plan_changed (otp_plan_t *plan, otp_fuseword_id_t id)
+{
+	if (plan == NULL || id >= OTP___FUSEWORD_COUNT)
+		return false;
+	return plan->desired[id] != plan->current[id];
+
+} /* otp_plan_changed */
+
+/*
+ * otp_plan_change_count
+ *
+ * Returns the number of fuse words the plan programs.
+ */
+unsigned int
+otp_plan_change_count (otp_plan_t *plan)
+{
+	otp_fuseword_id_t id;
+	unsigned int count = 0;
+
+	for (id = 0; id < OTP___FUSEWORD_COUNT; id++)
+		if (otp_plan_changed(plan, id))
+			count += 1;
+	return count;
+
+} /* otp_plan_change_count */
+
+/*
+ * otp_plan_apply
+ *
+ * Programs the fuse words changed by the plan.  The data
+ * words are programmed (and verified) first, and the LOCK
+ * word last, so a failure part-way through never leaves
+ * locked fuses that were meant to be programmed.  The fuses
+ * are read again first, bypassing the shadow copy, and if
+ * they have changed since the plan was started, nothing is
+ * programmed and errno is set to ESTALE.
+ *
+ * On success, the plan's current values are updated to
+ * match the desired ones.
+ */
+int
+otp_plan_apply (otpctx_t ctx, otp_plan_t *plan)
+{
+	otp_fuseword_id_t ids[OTP___FUSEWORD_COUNT], id;
+	uint32_t vals[OTP___FUSEWORD_COUNT], curval;
+	size_t count;
+
+	if (ctx == NULL || plan == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (otp___shadow_reload(ctx) < 0)
+		return -1;
+	for (id = 0, count = 0; id < OTP___FUSEWORD_COUNT; id++) {
+		if (otp___fuseword_read(ctx, id, &curval) < 0)
+			return -1;
+		if (curval != plan->current[id]) {
+			errno = ESTALE;
+			return -1;
+		}
+		if (id == OCOTP_LOCK || plan->desired[id] == curval)
+			continue;
+		ids[count] = id;
+		vals[count] = plan->desired[id];
+		count += 1;
+	}
+	if (count > 0 && otp___fuseword_write_multi(ctx, ids, vals, count) < 0)
+		return -1;
+	ids[0] = OCOTP_LOCK;
+	if (otp___fuseword_write_multi(ctx, ids, &plan->desired[OCOTP_LOCK], 1) < 0)
+		return -1;
+	memcpy(plan->current, plan->desired, sizeof(plan->current));
+	return 0;
+
+} /* otp_plan_apply */
@@ -0,0 +1,35 @@
+#ifndef otp_plan_h_included
+#define otp_plan_h_included
+/*
+ * otp_plan.h
+ *
+ * Definitions for planning and applying a set of
+ * fuse changes as a unit.
+ *
+ * Copyright (c) 2022, Matthew Madison.
+ */
+#include "otp.h"
+#include "otp_field.h"
+#include <stdint.h>
+
+/*
+ * A fuse plan holds the fuse words as they were read when
+ * the plan was started, and the values they should have
+ * once it is applied, along with the field table for the
+ * SoC they were read from.
+ */
+typedef struct {
+	uint32_t current[OTP_FUSEWORD_COUNT];
+	uint32_t desired[OTP_FUSEWORD_COUNT];
+	const otp_field_t *fields;
+} otp_plan_t;
+
+int otp_plan_init(otpctx_t ctx, otp_plan_t *plan);
+int otp_plan_get(otp_plan_t *plan, otp_fuseword_id_t id, uint32_t *value);
+int otp_plan_set(otp_plan_t *plan, otp_fuseword_id_t id, uint32_t value);
+int otp_plan_field_set(otp_plan_t *plan, otp_field_id_t id, uint32_t value);
+bool otp_plan_changed(otp_plan_t *plan, otp_fuseword_id_t id);
+unsigned int otp_plan_change_count(otp_plan_t *plan);
+int otp_plan_apply(otpctx_t ctx, otp_plan_t *plan);
+
+#endif /* otp_plan_h_included */
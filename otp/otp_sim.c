@@ -0,0 +1,107 @@
+/*
+ * otp_sim.c
+ *
+ * Simulated OCOTP fuse box, backed by an ordinary file
+ * holding an image of the nvmem fuse map, for exercising
+ * the library (and provisioning flows) on hosts without
+ * i.MX hardware.
+ *
+ * Copyright (c) 2022, Matthew Madison.
+ */
+
+#include <time.h>
+#include "otp_internal.h"
+#include "otp_lock.h"
+
+/*
+ * The range of fuse words covered by each of the locks.
+ * A write-protected (or, for 1-bit locks, locked) range
+ * cannot be programmed.
+ */
+static const struct {
+	otp_lock_id_t lock;
+	otp_fuseword_id_t first, last;
+} lock_ranges[] = {
+	{ OTP_LOCK_TESTER,	OCOTP_TESTER0,		OCOTP_TESTER5 },
+	{ OTP_LOCK_BOOT_CFG,	OCOTP_BOOT_CFG0,	OCOTP_BOOT_CFG4 },
+	{ OTP_LOCK_SRK,		OCOTP_SRK0,		OCOTP_SRK7 },
+	{ OTP_LOCK_SJC_RESP,	OCOTP_SJC_RESP0,	OCOTP_SJC_RESP1 },
+	{ OTP_LOCK_USB_ID,	OCOTP_USB_ID,		OCOTP_USB_ID },
+	{ OTP_LOCK_MAC_ADDR,	OCOTP_MAC_ADDR0,	OCOTP_MAC_ADDR2 },
+	{ OTP_LOCK_GP1,		OCOTP_GP10,		OCOTP_GP11 },
+	{ OTP_LOCK_GP2,		OCOTP_GP20,		OCOTP_GP21 },
+};
+
+/*
+ * is_write_locked
+ *
+ * Checks whether the locks fuse word prevents
+ * programming the word at an offset.
+ */
+static bool
+is_write_locked (const off_t *offsets, uint32_t lockword, off_t offset)
+{
+	otp_lockstate_t lstate;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(lock_ranges)/sizeof(lock_ranges[0]); i++) {
+		if (offset < offsets[lock_ranges[i].first] || offset > offsets[lock_ranges[i].last])
+			continue;
+		if (otp_lockstate_get(lockword, lock_ranges[i].lock, &lstate) < 0)
+			return true;
+		return (lstate == OTP_LOCKSTATE_LOCKED ||
+			lstate == OTP_LOCKSTATE_W_PROTECT ||
+			lstate == OTP_LOCKSTATE_OW_PROTECT);
+	}
+	return false;
+
+} /* is_write_locked */
+
+/*
+ * otp___sim_pwrite
+ *
+ * Programs a fuse word in a simulated fuse box.  As with
+ * real fuses, programming can only set bits, and a word
+ * covered by a write lock cannot be programmed.  Each word
+ * programmed takes latency_us microseconds.  The offsets
+ * table is the fuse map in use.  A write of anything but
+ * exactly one word is rejected, as the imx-ocotp driver
+ * does.
+ *
+ * Returns: number of bytes written, or -1 on error
+ * (errno set; EPERM if the word is locked).
+ */
+ssize_t INTERNAL
+otp___sim_pwrite (int fd, const off_t *offsets, const void *buf,
+		  size_t len, off_t offset, unsigned int latency_us)
+{
+	struct timespec delay = {
+		.tv_sec = latency_us / 1000000,
+		.tv_nsec = (latency_us % 1000000) * 1000,
+	};
+	const uint32_t *newval = buf;
+	uint32_t lockword, curval;
+
+	if (len != sizeof(uint32_t) || (offset % (off_t) sizeof(uint32_t)) != 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (pread(fd, &lockword, sizeof(lockword), offsets[OCOTP_LOCK]) != sizeof(lockword) ||
+	    pread(fd, &curval, sizeof(curval), offset) != sizeof(curval)) {
+		errno = EIO;
+		return -1;
+	}
+	if (is_write_locked(offsets, lockword, offset)) {
+		errno = EPERM;
+		return -1;
+	}
+	if (latency_us > 0)
+		nanosleep(&delay, NULL);
+	curval |= *newval;
+	if (pwrite(fd, &curval, sizeof(curval), offset) != sizeof(curval)) {
+		errno = EIO;
+		return -1;
+	}
+	return (ssize_t) len;
+
+} /* otp___sim_pwrite */
@@ -8,6 +8,7 @@
 
 #include "otp_internal.h"
 #include "otp_srk.h"
+#include "otp_plan.h"
 
 static const otp_fuseword_id_t srk_fuse[] = {
 	[0] = OCOTP_SRK0,
@@ -22,10 +23,10 @@ static const otp_fuseword_id_t srk_fuse[] = {
 
 /*
  * otp_srk_read
- * Read the SRK fuses. We could take a shortcut
- * here and read them all at once, but for some
- * future platform, the fuses might not be
- * contiguous.
+ * Read the SRK fuses.  These come from the context's
+ * shadow copy of the fuse words, which is read all at
+ * once, so there is no need to special-case the SRK
+ * fuses being contiguous.
  */
 ssize_t
 otp_srk_read (otpctx_t ctx, uint32_t *srk_hash, size_t sizeinwords)
@@ -44,7 +45,8 @@ otp_srk_read (otpctx_t ctx, uint32_t *srk_hash, size_t sizeinwords)
  * otp_srk_write
  * Blow the SRK fuses.  Will check to make sure the
  * current fuse is zero or matches the desired value
- * if non-zero.
+ * if non-zero, failing with EALREADY otherwise (as
+ * otp_macaddr_write does).
  */
 int
 otp_srk_write (otpctx_t ctx, uint32_t *newvals, size_t sizeinwords)
@@ -65,18 +67,42 @@ otp_srk_write (otpctx_t ctx, uint32_t *newvals, size_t sizeinwords)
 	 */
 	for (i = 0; i < SRK_FUSE_COUNT; i++) {
 		if (curvals[i] != 0 && curvals[i] != newvals[i]) {
-			errno = EINVAL;
+			errno = EALREADY;
 			return -1;
 		}
 	}
 
+	if (otp___fuseword_write_multi(ctx, srk_fuse, newvals, SRK_FUSE_COUNT) < 0)
+		return -1;
+
+	return SRK_FUSE_COUNT;
+
+} /* otp_srk_write */
+
+/*
+ * otp_srk_plan
+ * Adds the SRK fuses to a fuse plan, with the same
+ * check as otp_srk_write: each fuse must currently be
+ * zero or already match the desired value.
+ */
+int
+otp_srk_plan (otp_plan_t *plan, uint32_t *newvals, size_t sizeinwords)
+{
+	int i;
+
+	if (plan == NULL || newvals == NULL || sizeinwords != SRK_FUSE_COUNT) {
+		errno = EINVAL;
+		return -1;
+	}
 	for (i = 0; i < SRK_FUSE_COUNT; i++) {
-		if (curvals[i] == newvals[i])
-			continue;
-		if (otp___fuseword_write(ctx, srk_fuse[i], newvals[i]) < 0)
+		if (plan->current[srk_fuse[i]] != 0 && plan->current[srk_fuse[i]] != newvals[i]) {
+			errno = EALREADY;
 			return -1;
+		}
 	}
-
+	for (i = 0; i < SRK_FUSE_COUNT; i++)
+		if (otp_plan_set(plan, srk_fuse[i], newvals[i]) < 0)
+			return -1;
 	return SRK_FUSE_COUNT;
 
-} /* otp_srk_write */
+} /* otp_srk_plan */
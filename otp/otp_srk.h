@@ -8,6 +8,7 @@
  * Copyright (c) 2022, Matthew Madison.
  */
 #include "otp.h"
+#include "otp_plan.h"
 #include <unistd.h>
 #include <stdint.h>
 
@@ -15,5 +16,6 @@
 
 ssize_t otp_srk_read(otpctx_t ctx, uint32_t *srk_hash, size_t sizeinwords);
 int otp_srk_write(otpctx_t ctx, uint32_t *srk_hash, size_t sizeinwords);
+int otp_srk_plan(otp_plan_t *plan, uint32_t *srk_hash, size_t sizeinwords);
 
 #endif /* otp_srk_h_included */
@@ -0,0 +1,95 @@
+#!/bin/sh
+# SPDX-License-Identifier: MIT
+# Copyright (c) 2022, Matthew Madison
+#
+# Maps a loop device with keystoretool --activate and checks the
+# dm-crypt table it loads against the one cryptsetup loads for a
+# plain mapping of the same device, cipher and key size; only the
+# key reference may differ.  Also checks that data written through
+# the mapping reads back after the mapping is removed and set up
+# again from the stored key, and is not on the device in the clear.
+#
+# Needs root, device-mapper, losetup, dmsetup and cryptsetup;
+# exits with 77 (skipped) if any of these is missing.
+#
+# Usage: dmcrypt-check.sh KEYSTORETOOL STORE STORESIZE WORKDIR
+
+KEYSTORETOOL="$1"
+STORE="$2"
+STORESIZE="$3"
+WORKDIR="$4"
+CIPHER="aes-xts-plain64"
+KEYBITS=256
+NAME="kstest$$"
+
+skip() {
+    echo "SKIP: $*"
+    exit 77
+}
+
+fail() {
+    echo "FAIL: $*" >&2
+    exit 1
+}
+
+[ "$(id -u)" -eq 0 ] || skip "must be run as root"
+for tool in losetup dmsetup cryptsetup; do
+    command -v $tool >/dev/null 2>&1 || skip "$tool not installed"
+done
+dmsetup version >/dev/null 2>&1 || skip "device-mapper not available"
+
+loopdev=
+cleanup() {
+    dmsetup remove "$NAME" >/dev/null 2>&1
+    cryptsetup close "$NAME-ref" >/dev/null 2>&1
+    [ -z "$loopdev" ] || losetup -d "$loopdev"
+    rm -f "$WORKDIR/dmcrypt.img" "$WORKDIR/dmcrypt.key" "$WORKDIR/dmcrypt.data"
+}
+trap cleanup EXIT
+
+# fresh, uninitialized variable store, so new keys are generated
+truncate -s 0 "$STORE" && truncate -s "$STORESIZE" "$STORE" || fail "clearing store"
+truncate -s 16M "$WORKDIR/dmcrypt.img" || fail "creating backing file"
+loopdev=$(losetup -f --show "$WORKDIR/dmcrypt.img") || fail "setting up loop device"
+
+activate() {
+    "$KEYSTORETOOL" --key-backend software --volume "$NAME" \
+        --activate "$NAME:$loopdev" --cipher "$CIPHER" --dmc-passphrase >/dev/null ||
+        fail "keystoretool --activate"
+}
+
+# table fields: start length target cipher key iv_offset device offset [options]
+activate
+ours=$(dmsetup table "$NAME" | awk '{ $5 = "KEY"; print }')
+case "$(dmsetup table --showkeys "$NAME" | awk '{ print $5 }')" in
+    :$((KEYBITS / 8)):encrypted:*) ;;
+    *) fail "key not referenced as an encrypted key in the keyring" ;;
+esac
+
+head -c 1048576 /dev/urandom > "$WORKDIR/dmcrypt.data"
+dd if="$WORKDIR/dmcrypt.data" of="/dev/mapper/$NAME" bs=64k oflag=direct status=none ||
+    fail "writing through the mapping"
+dmsetup remove "$NAME" || fail "removing the mapping"
+[ ! -b "/dev/mapper/$NAME" ] || rm -f "/dev/mapper/$NAME"
+if cmp -s -n 1048576 "$WORKDIR/dmcrypt.data" "$loopdev"; then
+    fail "data is on the device in the clear"
+fi
+
+head -c $((KEYBITS / 8)) /dev/urandom > "$WORKDIR/dmcrypt.key"
+cryptsetup open --type plain --cipher "$CIPHER" --key-size $KEYBITS \
+    --key-file "$WORKDIR/dmcrypt.key" "$loopdev" "$NAME-ref" || fail "cryptsetup open"
+theirs=$(dmsetup table "$NAME-ref" | awk '{ $5 = "KEY"; print }')
+cryptsetup close "$NAME-ref" || fail "cryptsetup close"
+echo "keystoretool: $ours"
+echo "cryptsetup:   $theirs"
+[ "$ours" = "$theirs" ] || fail "tables differ"
+
+# the keys are now loaded from the store rather than generated
+activate
+cmp -s -n 1048576 "$WORKDIR/dmcrypt.data" "/dev/mapper/$NAME" ||
+    fail "data did not read back after reactivation"
+dmsetup remove "$NAME" || fail "removing the mapping"
+[ ! -b "/dev/mapper/$NAME" ] || rm -f "/dev/mapper/$NAME"
+
+echo "all checks passed"
+exit 0
@@ -0,0 +1,140 @@
+#!/bin/sh
+# SPDX-License-Identifier: MIT
+# Copyright (c) 2022, Matthew Madison
+#
+# Runs imx-otp-tool against simulated fuse boxes, checking that
+# secure and provision program what they should and read it back
+# afterwards, that a bad manifest line or a conflict with fuses
+# already blown programs nothing, that --dry-run leaves the fuses
+# alone, that fuse bits can only be set, never cleared, and that
+# a word covered by a lock cannot be programmed.
+#
+# Usage: otp-tool-check.sh WORKDIR TOOL [ARG...]
+#
+# where TOOL and any ARGs are the command that runs imx-otp-tool
+# (for the multi-call build, the binary followed by the tool name).
+
+WORKDIR="$1"
+shift
+IMAGE="$WORKDIR/otp-tool.img"
+SAVED="$WORKDIR/otp-tool-saved.img"
+SRKFILE="$WORKDIR/otp-tool-srk.bin"
+MANIFEST="$WORKDIR/otp-tool-manifest.txt"
+OUTPUT="$WORKDIR/otp-tool.out"
+
+fail() {
+    echo "FAIL: $*" >&2
+    [ -f "$OUTPUT" ] && cat "$OUTPUT" >&2
+    exit 1
+}
+
+# Runs the tool on the simulated fuse box, with its output saved
+tool() {
+    "$TOOLCMD" $TOOLARGS --simulate "$IMAGE" "$@" >"$OUTPUT" 2>&1
+}
+
+field_is() {
+    tool get-field "$1" || fail "get-field $1"
+    grep -q "^$1 *$2\$" "$OUTPUT" || fail "$1 is not $2"
+}
+
+TOOLCMD="$1"
+shift
+TOOLARGS="$*"
+
+mkdir -p "$WORKDIR" || fail "could not create $WORKDIR"
+rm -f "$IMAGE" "$SAVED"
+# SRK hash fuse file, with words 0x03020100, 0x07060504, ...
+printf '\000\001\002\003\004\005\006\007\010\011\012\013\014\015\016\017' >"$SRKFILE"
+printf '\020\021\022\023\024\025\026\027\030\031\032\033\034\035\036\037' >>"$SRKFILE"
+
+# secure: programs the SRK hash, its lock and SEC_CONFIG, and
+# finds them all in place when run again
+tool is-secured && fail "blank fuses reported as secured"
+tool --fuse-file "$SRKFILE" secure || fail "secure"
+tool is-secured || fail "not secured after secure"
+tool --fuse-file "$SRKFILE" secure || fail "secure, second time"
+grep -q "SRK fuses already programmed correctly" "$OUTPUT" || fail "SRK hash did not read back"
+grep -q "No fuses need programming" "$OUTPUT" || fail "secure reprogrammed fuses"
+field_is LOCK_SRK 1
+field_is SEC_CONFIG 1
+
+# A different hash conflicts with the one programmed
+printf '\377\001\002\003\004\005\006\007\010\011\012\013\014\015\016\017' >"$SRKFILE.new"
+printf '\020\021\022\023\024\025\026\027\030\031\032\033\034\035\036\037' >>"$SRKFILE.new"
+tool --fuse-file "$SRKFILE.new" secure && fail "secure with a different SRK hash"
+grep -q "already programmed with different hashes" "$OUTPUT" || fail "no SRK conflict error"
+rm -f "$SRKFILE.new"
+
+# provision: a bad line anywhere means nothing is programmed
+rm -f "$IMAGE"
+cat >"$MANIFEST" <<EOF
+gp10 = 0x12345678
+no-such-setting = 1
+EOF
+tool provision "$MANIFEST" && fail "provision with a bad line"
+grep -q ":2: unrecognized setting" "$OUTPUT" || fail "bad line not reported"
+field_is GP10 0x00000000
+
+cat >"$MANIFEST" <<EOF
+# unit manifest
+srk-hash = 0x03020100 0x07060504 0x0b0a0908 0x0f0e0d0c 0x13121110 0x17161514 0x1b1a1918 0x1f1e1d1c
+mac-address = 00:04:9f:01:02:03
+gp10 = 0x12345678
+watchdog = 16
+sec-config = yes
+lock = SRK
+lock = GP1
+EOF
+
+# --dry-run lists the changes but programs nothing
+tool provision "$MANIFEST" || fail "provision, before --dry-run"
+cp "$IMAGE" "$SAVED"
+rm -f "$IMAGE"
+tool --dry-run provision "$MANIFEST" || fail "provision --dry-run"
+grep -q "Fuses that would be programmed" "$OUTPUT" || fail "--dry-run did not list changes"
+grep -q "GP10 .*-> 0x12345678" "$OUTPUT" || fail "--dry-run did not list GP10"
+field_is GP10 0x00000000
+field_is LOCK_GP1 0
+
+# The real run; everything reads back, and the SRK hash
+# matches the one secure programs from the fuse file
+tool provision "$MANIFEST" || fail "provision"
+cmp -s "$IMAGE" "$SAVED" || fail "provision differs from the first run"
+field_is GP10 0x12345678
+field_is WDOG_ENABLE 1
+field_is LOCK_SRK 1
+field_is LOCK_GP1 3
+tool --fuse-file "$SRKFILE" secure || fail "secure after provision"
+grep -q "SRK fuses already programmed correctly" "$OUTPUT" || fail "provisioned SRK hash differs"
+tool provision "$MANIFEST" || fail "provision, second time"
+grep -q "No fuses need programming" "$OUTPUT" || fail "provision reprogrammed fuses"
+
+# A manifest that conflicts with blown fuses programs nothing
+cp "$IMAGE" "$SAVED"
+cat >"$MANIFEST" <<EOF
+gp20 = 1
+gp10 = 0x00000001
+EOF
+tool provision "$MANIFEST" && fail "provision over blown fuses"
+grep -q ":2: gp10 already programmed" "$OUTPUT" || fail "conflict not reported"
+cmp -s "$IMAGE" "$SAVED" || fail "conflicting manifest programmed fuses"
+
+# Fuse bits can only be set
+tool set-field WDOG_TIMEOUT=1 && fail "set-field cleared fuse bits"
+grep -q "cannot clear fuses" "$OUTPUT" || fail "no error for clearing fuse bits"
+cmp -s "$IMAGE" "$SAVED" || fail "set-field clearing bits programmed fuses"
+tool set-field WDOG_TIMEOUT=3 || fail "set-field setting bits"
+field_is WDOG_TIMEOUT 3
+
+# GP1 is locked, so GP11 cannot be programmed, while
+# the unlocked GP2 words can
+cp "$IMAGE" "$SAVED"
+tool set-field GP11=1 && fail "programmed a locked fuse word"
+grep -q "Operation not permitted" "$OUTPUT" || fail "no EPERM for a locked fuse word"
+cmp -s "$IMAGE" "$SAVED" || fail "locked fuse word was programmed"
+tool set-field GP21=1 || fail "set-field on an unlocked word"
+field_is GP21 0x00000001
+
+rm -f "$IMAGE" "$SAVED" "$SRKFILE" "$MANIFEST" "$OUTPUT"
+exit 0
@@ -0,0 +1,373 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * test-fault-sweep.c
+ *
+ * Interrupts a store update, and a forced initialization,
+ * at every sector boundary using the library's fault
+ * injection hook, then checks which copy of the store
+ * is used afterwards, which variables survived, and that
+ * the store can be updated again.  The time taken to open
+ * the store after each interruption is reported.
+ *
+ * The hook counts sectors from the first write a process
+ * makes, so every write is done in a child process.
+ *
+ * An update writes the invalidated header block, the
+ * extension sectors, and the new header block, in that
+ * order, to the copy that is not current; a forced
+ * initialization then also invalidates the old copy.
+ *
+ * Copyright (c) 2022, Matthew Madison
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "bootinfo.h"
+#include "testutil.h"
+
+#define UPDATE_SECTORS (1 + TEST_STORE_SECTORS + 1)
+#define RECOVERY_LIMIT_NS 100000000L
+
+struct store_state {
+	int current;
+	unsigned int sernum;
+	bool other_valid;
+};
+
+static int failures;
+static long max_recovery_ns;
+
+/*
+ * check
+ */
+static void
+check (bool ok, const char *what, int sectors, const char *detail)
+{
+	if (ok)
+		return;
+	fprintf(stderr, "FAIL: %s, fault after %d sectors: %s\n", what, sectors, detail);
+	failures += 1;
+
+} /* check */
+
+/*
+ * op_update
+ */
+static int
+op_update (const void *arg __attribute__((unused)))
+{
+	bootinfo_ctx_t *ctx;
+	int ret;
+
+	if (bootinfo_open_store(&ctx, NULL, 0) < 0)
+		return -1;
+	ret = bootinfo_bootvar_set(ctx, "var", "new");
+	if (ret == 0)
+		ret = bootinfo_update(ctx);
+	bootinfo_close(ctx);
+	return ret;
+
+} /* op_update */
+
+/*
+ * op_force_init
+ */
+static int
+op_force_init (const void *arg __attribute__((unused)))
+{
+	bootinfo_ctx_t *ctx;
+
+	if (bootinfo_open_store(&ctx, NULL, BOOTINFO_O_FORCE_INIT) < 0) {
+		if (ctx != NULL)
+			bootinfo_close(ctx);
+		return -1;
+	}
+	bootinfo_close(ctx);
+	return 0;
+
+} /* op_force_init */
+
+/*
+ * run_child
+ *
+ * Runs an operation in a child process.  If sectors is
+ * not negative, only that many sectors written by the
+ * child reach the store.  Returns 0 if the operation
+ * succeeded, 1 if it failed.
+ */
+static int
+run_child (int sectors, int (*op)(const void *), const void *arg)
+{
+	char env[16];
+	pid_t pid;
+	int status;
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		exit(1);
+	}
+	if (pid == 0) {
+		if (sectors >= 0) {
+			snprintf(env, sizeof(env), "%d", sectors);
+			setenv("IMX_BOOTINFO_FAULT_SECTORS", env, 1);
+		}
+		_exit(op(arg) == 0 ? 0 : 1);
+	}
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status)) {
+		fprintf(stderr, "child did not exit\n");
+		exit(1);
+	}
+	return WEXITSTATUS(status);
+
+} /* run_faulted */
+
+/*
+ * op_set_vars
+ */
+static int
+op_set_vars (const void *arg)
+{
+	const char *const *vars = arg;
+	bootinfo_ctx_t *ctx;
+	int ret = 0;
+
+	if (bootinfo_open_store(&ctx, NULL, 0) < 0)
+		return -1;
+	for (; ret == 0 && vars[0] != NULL; vars += 2)
+		ret = bootinfo_bootvar_set(ctx, vars[0], vars[1]);
+	if (ret == 0)
+		ret = bootinfo_update(ctx);
+	bootinfo_close(ctx);
+	return ret;
+
+} /* op_set_vars */
+
+/*
+ * setup_store
+ *
+ * Initializes the store and writes the starting
+ * variables, leaving both copies valid.
+ */
+static void
+setup_store (void)
+{
+	static const char *const first[] = { "var", "older", NULL };
+	static const char *const second[] = { "var", "old", "keep", "yes", "_preserved", "yes", NULL };
+
+	if (test_store_init() < 0 || run_child(-1, op_set_vars, first) != 0 ||
+	    run_child(-1, op_set_vars, second) != 0) {
+		fprintf(stderr, "setting up store failed\n");
+		exit(1);
+	}
+
+} /* setup_store */
+
+/*
+ * get_state
+ *
+ * Examines the copies of the store without locking
+ * it, to find out which is current.
+ */
+static int
+get_state (struct store_state *state)
+{
+	struct bootinfo_copy_status status;
+	bootinfo_ctx_t *ctx;
+	unsigned int i;
+
+	if (bootinfo_open_image(&ctx, TEST_STORE_PATH, NULL) < 0)
+		return -1;
+	state->current = -1;
+	state->other_valid = false;
+	for (i = 0; i < BOOTINFO_COPY_COUNT; i++) {
+		if (bootinfo_copy_status(ctx, i, &status) < 0) {
+			bootinfo_close(ctx);
+			return -1;
+		}
+		if (status.current) {
+			state->current = i;
+			state->sernum = status.sernum;
+		} else if (status.valid)
+			state->other_valid = true;
+	}
+	bootinfo_close(ctx);
+	return 0;
+
+} /* get_state */
+
+/*
+ * check_vars
+ *
+ * Opens the store read-only, timing the open, and
+ * checks variable values; a NULL expected value
+ * means the variable must not exist.
+ */
+static void
+check_vars (const char *what, int sectors, const char *const *vars)
+{
+	struct timespec start, end;
+	bootinfo_ctx_t *ctx;
+	char *value, detail[128];
+	long ns;
+	int ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ret = bootinfo_open_store(&ctx, NULL, BOOTINFO_O_RDONLY);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (ret < 0) {
+		check(false, what, sectors, "store could not be opened");
+		return;
+	}
+	ns = (end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec);
+	if (ns > max_recovery_ns)
+		max_recovery_ns = ns;
+	check(ns < RECOVERY_LIMIT_NS, what, sectors, "open took too long");
+	for (; vars[0] != NULL; vars += 2) {
+		ret = bootinfo_bootvar_get(ctx, vars[0], &value);
+		if (vars[1] == NULL)
+			snprintf(detail, sizeof(detail), "%s should not exist", vars[0]);
+		else
+			snprintf(detail, sizeof(detail), "%s should be %s, is %s", vars[0], vars[1],
+				 (ret < 0 ? "missing" : value));
+		check((vars[1] == NULL ? ret < 0 : ret == 0 && strcmp(value, vars[1]) == 0),
+		      what, sectors, detail);
+	}
+	bootinfo_close(ctx);
+
+} /* check_vars */
+
+/*
+ * check_writable
+ *
+ * Checks that the store can be updated again.
+ */
+static void
+check_writable (const char *what, int sectors)
+{
+	static const char *const after[] = { "after", "yes", NULL };
+
+	check(run_child(-1, op_set_vars, after) == 0, what, sectors, "store could not be updated afterwards");
+	check_vars(what, sectors, after);
+
+} /* check_writable */
+
+/*
+ * sweep_update
+ *
+ * An update must leave either the old variables in the
+ * old copy, or the new ones in the new copy, which
+ * takes over only once its header block is written.
+ */
+static void
+sweep_update (void)
+{
+	static const char *const oldvars[] = { "var", "old", "keep", "yes", NULL };
+	static const char *const newvars[] = { "var", "new", "keep", "yes", NULL };
+	struct store_state before, after;
+	int sectors;
+	bool done;
+	int ret;
+
+	for (sectors = 0; sectors <= UPDATE_SECTORS + 1; sectors++) {
+		setup_store();
+		if (get_state(&before) < 0 || before.current < 0) {
+			check(false, "update", sectors, "store not set up");
+			continue;
+		}
+		ret = run_child(sectors, op_update, NULL);
+		done = (sectors >= UPDATE_SECTORS);
+		check(ret == (done ? 0 : 1), "update", sectors,
+		      done ? "update failed" : "update did not report the fault");
+		if (get_state(&after) < 0) {
+			check(false, "update", sectors, "store image could not be examined");
+			continue;
+		}
+		if (done) {
+			check(after.current == 1 - before.current, "update", sectors, "new copy not current");
+			check(after.sernum == ((before.sernum + 1) & 0xff), "update", sectors, "wrong serial number");
+			check_vars("update", sectors, newvars);
+		} else {
+			check(after.current == before.current, "update", sectors, "old copy not current");
+			check(after.sernum == before.sernum, "update", sectors, "serial number changed");
+			check(!after.other_valid || sectors == 0, "update", sectors, "torn copy still valid");
+			check_vars("update", sectors, oldvars);
+		}
+		check_writable("update", sectors);
+	}
+
+} /* sweep_update */
+
+/*
+ * sweep_force_init
+ *
+ * A forced initialization writes the new store as an
+ * update, keeping only the underscore-prefixed variables,
+ * and then invalidates the old copy.
+ */
+static void
+sweep_force_init (void)
+{
+	static const char *const oldvars[] = { "var", "old", "keep", "yes", "_preserved", "yes", NULL };
+	static const char *const newvars[] = { "var", NULL, "keep", NULL, "_preserved", "yes", NULL };
+	struct store_state before, after;
+	int sectors;
+	bool written, done;
+	int ret;
+
+	for (sectors = 0; sectors <= UPDATE_SECTORS + 2; sectors++) {
+		setup_store();
+		if (get_state(&before) < 0 || before.current < 0) {
+			check(false, "force-init", sectors, "store not set up");
+			continue;
+		}
+		ret = run_child(sectors, op_force_init, NULL);
+		written = (sectors >= UPDATE_SECTORS);
+		done = (sectors >= UPDATE_SECTORS + 1);
+		check(ret == (done ? 0 : 1), "force-init", sectors,
+		      done ? "initialization failed" : "initialization did not report the fault");
+		if (get_state(&after) < 0) {
+			check(false, "force-init", sectors, "store image could not be examined");
+			continue;
+		}
+		if (written) {
+			check(after.current == 1 - before.current, "force-init", sectors, "new copy not current");
+			check(after.sernum == ((before.sernum + 1) & 0xff), "force-init", sectors, "wrong serial number");
+			check(after.other_valid == !done, "force-init", sectors,
+			      done ? "old copy not invalidated" : "old copy invalidated");
+			check_vars("force-init", sectors, newvars);
+		} else {
+			check(after.current == before.current, "force-init", sectors, "old copy not current");
+			check_vars("force-init", sectors, oldvars);
+		}
+		check_writable("force-init", sectors);
+	}
+
+} /* sweep_force_init */
+
+/*
+ * main program
+ */
+int
+main (void)
+{
+	sweep_update();
+	sweep_force_init();
+	printf("slowest open after a fault: %ld us\n", max_recovery_ns / 1000);
+	if (failures > 0) {
+		fprintf(stderr, "%d check(s) failed\n", failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+
+} /* main */
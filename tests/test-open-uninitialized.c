@@ -0,0 +1,145 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * test-open-uninitialized.c
+ *
+ * Checks that failed opens of a store that has never
+ * been initialized leave no context behind and the
+ * store unlocked: a read-only open must fail with
+ * ENODATA, after which a read-write open in the same
+ * process (as keystoretool does) must initialize the
+ * store rather than wait forever for the lock.  A
+ * read-write open whose initialization fails must
+ * also release the lock.
+ *
+ * Copyright (c) 2022, Matthew Madison
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "bootinfo.h"
+#include "testutil.h"
+
+#define TIMEOUT_SECS 10
+
+static int failures;
+
+/*
+ * timed_out
+ */
+static void
+timed_out (int sig __attribute__((unused)))
+{
+	static const char msg[] = "FAIL: open blocked; store left locked\n";
+
+	if (write(STDERR_FILENO, msg, sizeof(msg) - 1) < 0)
+		_exit(2);
+	_exit(1);
+
+} /* timed_out */
+
+/*
+ * check
+ */
+static void
+check (int ok, const char *what)
+{
+	if (ok)
+		return;
+	fprintf(stderr, "FAIL: %s\n", what);
+	failures += 1;
+
+} /* check */
+
+/*
+ * readonly_then_readwrite
+ */
+static void
+readonly_then_readwrite (void)
+{
+	bootinfo_ctx_t *ctx = (bootinfo_ctx_t *) &ctx;
+	int ret;
+
+	if (test_store_clear() < 0)
+		exit(1);
+	ret = bootinfo_open_store(&ctx, NULL, BOOTINFO_O_RDONLY);
+	check(ret < 0 && errno == ENODATA, "read-only open did not fail with ENODATA");
+	check(ctx == NULL, "read-only open left a context");
+	if (ret == 0)
+		bootinfo_close(ctx);
+
+	alarm(TIMEOUT_SECS);
+	ret = bootinfo_open_store(&ctx, NULL, 0);
+	alarm(0);
+	check(ret == 0, "read-write open did not initialize the store");
+	if (ret < 0)
+		return;
+	bootinfo_close(ctx);
+
+	ret = bootinfo_open_store(&ctx, NULL, BOOTINFO_O_RDONLY);
+	check(ret == 0, "read-only open failed after initialization");
+	if (ret == 0)
+		bootinfo_close(ctx);
+
+} /* readonly_then_readwrite */
+
+/*
+ * failed_init
+ *
+ * Runs in a child, since the fault injection hook
+ * applies to the whole process.  The hook reads its
+ * setting on a process's first write, so this must
+ * run before the parent writes to the store.
+ */
+static void
+failed_init (void)
+{
+	bootinfo_ctx_t *ctx = (bootinfo_ctx_t *) &ctx;
+	pid_t pid;
+	int status, ret;
+
+	if (test_store_clear() < 0)
+		exit(1);
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		exit(1);
+	}
+	if (pid == 0) {
+		setenv("IMX_BOOTINFO_FAULT_SECTORS", "0", 1);
+		ret = bootinfo_open_store(&ctx, NULL, 0);
+		check(ret < 0 && errno == EIO, "failed initialization did not report EIO");
+		check(ctx == NULL, "failed initialization left a context");
+		alarm(TIMEOUT_SECS);
+		ret = bootinfo_open_store(&ctx, NULL, BOOTINFO_O_RDONLY);
+		alarm(0);
+		check(ret < 0 && errno == ENODATA, "store changed by failed initialization");
+		_exit(failures == 0 ? 0 : 1);
+	}
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		failures += 1;
+
+} /* failed_init */
+
+/*
+ * main program
+ */
+int
+main (void)
+{
+	signal(SIGALRM, timed_out);
+	failed_init();
+	readonly_then_readwrite();
+	if (failures > 0)
+		return 1;
+	printf("all checks passed\n");
+	return 0;
+
+} /* main */
@@ -0,0 +1,96 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * test-otp-plan.c
+ *
+ * Checks, against a simulated fuse box, that a fuse plan
+ * is not applied if the fuses were changed (here, through
+ * another context) after the plan was started: the apply
+ * must fail with ESTALE and program nothing.  A plan
+ * started afresh must then apply.
+ *
+ * Copyright (c) 2022, Matthew Madison
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "otp.h"
+#include "otp_plan.h"
+
+static int failures;
+
+/*
+ * check
+ */
+static void
+check (int ok, const char *what)
+{
+	if (!ok) {
+		printf("FAIL: %s\n", what);
+		failures += 1;
+	}
+
+} /* check */
+
+/*
+ * open_sim
+ */
+static otpctx_t
+open_sim (const char *path)
+{
+	otpctx_t ctx;
+
+	if (otp_context_open_simulated(path, false, 0, &ctx) < 0) {
+		perror(path);
+		return NULL;
+	}
+	return ctx;
+
+} /* open_sim */
+
+int
+main (int argc, char **argv)
+{
+	otpctx_t ctx = NULL, other = NULL;
+	otp_plan_t plan, otherplan;
+	int ret;
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s IMAGE\n", argv[0]);
+		return 1;
+	}
+	unlink(argv[1]);
+	ctx = open_sim(argv[1]);
+	other = open_sim(argv[1]);
+	if (ctx == NULL || other == NULL)
+		return 1;
+
+	/* start a plan, then change the fuses through another context */
+	check(otp_plan_init(ctx, &plan) == 0, "plan init");
+	check(otp_plan_init(other, &otherplan) == 0, "other plan init");
+	check(otp_plan_set(&otherplan, OCOTP_GP10, 0x1) == 0, "other plan set");
+	check(otp_plan_apply(other, &otherplan) == 0, "other plan apply");
+
+	check(otp_plan_set(&plan, OCOTP_GP11, 0x2) == 0, "plan set");
+	ret = otp_plan_apply(ctx, &plan);
+	check(ret < 0 && errno == ESTALE, "stale plan rejected with ESTALE");
+	check(otp_plan_init(other, &otherplan) == 0 &&
+	      otherplan.current[OCOTP_GP11] == 0, "stale plan programmed nothing");
+
+	/* a fresh plan sees the change and applies */
+	check(otp_plan_init(ctx, &plan) == 0 &&
+	      plan.current[OCOTP_GP10] == 0x1, "fresh plan sees other change");
+	check(otp_plan_set(&plan, OCOTP_GP11, 0x2) == 0, "fresh plan set");
+	check(otp_plan_apply(ctx, &plan) == 0, "fresh plan apply");
+	check(otp_plan_init(other, &otherplan) == 0 &&
+	      otherplan.current[OCOTP_GP11] == 0x2, "fresh plan programmed");
+
+	otp_context_close(&ctx);
+	otp_context_close(&other);
+	unlink(argv[1]);
+	if (failures == 0)
+		printf("PASS\n");
+	return failures == 0 ? 0 : 1;
+
+} /* main */
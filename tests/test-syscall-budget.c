@@ -0,0 +1,164 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * test-syscall-budget.c
+ *
+ * Counts the system calls made by a read-only open and
+ * close of a store, traced with PTRACE_SYSCALL, and fails
+ * if they exceed the budget.  The first open in a process
+ * also opens the lock directory and lock file; later opens
+ * reuse the cached fds.  Memory management calls are not
+ * counted, as they depend on the allocator's state; nor is
+ * getrandom(), which glibc's malloc makes on first use.
+ *
+ * Copyright (c) 2022, Matthew Madison
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include "bootinfo.h"
+#include "testutil.h"
+
+/* open device, open lock directory, open lock file, flock, pread */
+#define COLD_OPEN_BUDGET	5
+/* open device, flock, pread */
+#define WARM_OPEN_BUDGET	3
+/* flock, close device */
+#define CLOSE_BUDGET		2
+
+/*
+ * traced_child
+ *
+ * Runs the operations being measured, separated by
+ * getppid() calls, which the library never makes,
+ * as markers for the tracer.
+ */
+static void __attribute__((noreturn))
+traced_child (void)
+{
+	bootinfo_ctx_t *ctx;
+	int ok = 1;
+
+	if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) < 0)
+		_exit(TEST_SKIP);
+	raise(SIGSTOP);
+	syscall(SYS_getppid);
+	ok &= (bootinfo_open_store(&ctx, NULL, BOOTINFO_O_RDONLY) == 0);
+	syscall(SYS_getppid);
+	bootinfo_close(ctx);
+	syscall(SYS_getppid);
+	ok &= (bootinfo_open_store(&ctx, NULL, BOOTINFO_O_RDONLY) == 0);
+	syscall(SYS_getppid);
+	bootinfo_close(ctx);
+	syscall(SYS_getppid);
+	_exit(ok ? 0 : 1);
+
+} /* traced_child */
+
+/*
+ * counted
+ */
+static bool
+counted (unsigned long nr)
+{
+	switch (nr) {
+	case SYS_brk:
+	case SYS_mmap:
+	case SYS_munmap:
+	case SYS_mremap:
+	case SYS_madvise:
+	case SYS_mprotect:
+	case SYS_getrandom:
+		return false;
+	default:
+		return true;
+	}
+
+} /* counted */
+
+/*
+ * main program
+ */
+int
+main (void)
+{
+	static const char *phases[] = { "cold open", "close", "warm open", "close" };
+	static const int budgets[] = { COLD_OPEN_BUDGET, CLOSE_BUDGET, WARM_OPEN_BUDGET, CLOSE_BUDGET };
+	int counts[4] = { 0 };
+	struct __ptrace_syscall_info info;
+	pid_t pid;
+	int status, phase = -1, i, ret = 0;
+	bool skipped = false;
+
+	if (test_store_init() < 0)
+		return 1;
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return 1;
+	}
+	if (pid == 0)
+		traced_child();
+	if (waitpid(pid, &status, 0) < 0 || !WIFSTOPPED(status)) {
+		if (WIFEXITED(status) && WEXITSTATUS(status) == TEST_SKIP) {
+			printf("SKIP: ptrace not permitted\n");
+			return TEST_SKIP;
+		}
+		fprintf(stderr, "child did not stop\n");
+		return 1;
+	}
+	ptrace(PTRACE_SETOPTIONS, pid, NULL, PTRACE_O_TRACESYSGOOD|PTRACE_O_EXITKILL);
+	for (;;) {
+		if (ptrace(PTRACE_SYSCALL, pid, NULL, NULL) < 0 ||
+		    waitpid(pid, &status, 0) < 0) {
+			perror("ptrace");
+			return 1;
+		}
+		if (WIFEXITED(status) || WIFSIGNALED(status))
+			break;
+		if (WSTOPSIG(status) != (SIGTRAP|0x80))
+			continue;
+		if (ptrace(PTRACE_GET_SYSCALL_INFO, pid, sizeof(info), &info) <= 0) {
+			if (errno == EIO || errno == EINVAL) {
+				skipped = true;
+				continue;
+			}
+			perror("PTRACE_GET_SYSCALL_INFO");
+			return 1;
+		}
+		if (info.op != PTRACE_SYSCALL_INFO_ENTRY)
+			continue;
+		if (info.entry.nr == SYS_getppid)
+			phase += 1;
+		else if (phase >= 0 && phase < 4 && counted(info.entry.nr))
+			counts[phase] += 1;
+	}
+	if (skipped) {
+		printf("SKIP: PTRACE_GET_SYSCALL_INFO not supported\n");
+		return TEST_SKIP;
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || phase != 4) {
+		fprintf(stderr, "FAIL: read-only open did not succeed\n");
+		return 1;
+	}
+	for (i = 0; i < 4; i++) {
+		printf("%-10s %d syscalls (budget %d)\n", phases[i], counts[i], budgets[i]);
+		if (counts[i] > budgets[i]) {
+			fprintf(stderr, "FAIL: %s over budget\n", phases[i]);
+			ret = 1;
+		}
+	}
+	return ret;
+
+} /* main */
@@ -0,0 +1,100 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * testutil.c
+ *
+ * Helpers shared by the tests.
+ *
+ * Copyright (c) 2022, Matthew Madison
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "bootinfo.h"
+#include "testutil.h"
+
+/*
+ * test_store_clear
+ *
+ * Replaces the store with an all-zero
+ * (never initialized) one.
+ */
+int
+test_store_clear (void)
+{
+	int fd;
+
+	fd = open(TEST_STORE_PATH, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+	if (fd < 0 || ftruncate(fd, TEST_STORE_SIZE) < 0) {
+		perror(TEST_STORE_PATH);
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+	close(fd);
+	return 0;
+
+} /* test_store_clear */
+
+/*
+ * test_store_init
+ *
+ * Clears and initializes the store.  The
+ * initialization is done in a child process,
+ * so the library's per-process state (cached
+ * lock fds) starts out empty in the caller.
+ */
+int
+test_store_init (void)
+{
+	bootinfo_ctx_t *ctx;
+	pid_t pid;
+	int status;
+
+	if (test_store_clear() < 0)
+		return -1;
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return -1;
+	}
+	if (pid == 0) {
+		if (bootinfo_open_store(&ctx, NULL, 0) < 0) {
+			perror("initializing store");
+			_exit(1);
+		}
+		bootinfo_close(ctx);
+		_exit(0);
+	}
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		return -1;
+	return 0;
+
+} /* test_store_init */
+
+/*
+ * test_store_read
+ *
+ * Reads the raw contents of the store.
+ */
+int
+test_store_read (void *buf, size_t len)
+{
+	int fd;
+	ssize_t n;
+
+	fd = open(TEST_STORE_PATH, O_RDONLY|O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	n = pread(fd, buf, len, 0);
+	close(fd);
+	return (n == (ssize_t) len ? 0 : -1);
+
+} /* test_store_read */
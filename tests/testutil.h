@@ -0,0 +1,25 @@
+#ifndef testutil_h_included
+#define testutil_h_included
+/* SPDX-License-Identifier: MIT */
+/*
+ * testutil.h
+ *
+ * Helpers shared by the tests, which run against
+ * the default store of the bootinfo-test library,
+ * backed by a file in the build tree.
+ *
+ * Copyright (c) 2022, Matthew Madison
+ */
+#include <stddef.h>
+
+/* exit status ctest treats as a skipped test */
+#define TEST_SKIP 77
+
+/* size of both copies of the store */
+#define TEST_STORE_SIZE (2 * (512 + TEST_STORE_SECTORS * 512))
+
+int test_store_clear(void);
+int test_store_init(void);
+int test_store_read(void *buf, size_t len);
+
+#endif /* testutil_h_included */
@@ -16,46 +16,69 @@
 #include "util.h"
 
 /*
- * set_bootdev_writeable_status
+ * bootdev_force_ro_open
  *
- * Toggles the read-only soft switch in sysfs for eMMC boot0/boot1
- * devices, if present.
+ * Opens the sysfs read-only soft switch for an eMMC
+ * boot0/boot1 device.  Other devices have no switch
+ * that needs toggling, so sysfs is not consulted
+ * for them at all.
  *
  * bootdev: device name
+ *
+ * Returns: fd on success, negative value if
+ * the device has no switch.
+ */
+int
+bootdev_force_ro_open (const char *bootdev)
+{
+	char pathname[64];
+	const char *devname, *cp;
+
+	if (bootdev == NULL || strncmp(bootdev, "/dev/", 5) != 0)
+		return -1;
+	devname = bootdev + 5;
+	if (strlen(devname) > 32)
+		return -1;
+	cp = strstr(devname, "boot");
+	if (cp == NULL || cp == devname || !isdigit(cp[4]) || cp[5] != '\0')
+		return -1;
+	sprintf(pathname, "/sys/block/%s/force_ro", devname);
+	return open(pathname, O_RDWR|O_CLOEXEC);
+
+} /* bootdev_force_ro_open */
+
+/*
+ * set_bootdev_writeable_status
+ *
+ * Toggles the read-only soft switch opened by
+ * bootdev_force_ro_open, if it is not already
+ * in the requested state.
+ *
+ * fd: fd of the switch
  * make_writeable: true for wrieable, false otherwise
  *
  * Returns: true if changed, false otherwise
  *
  */
 bool
-set_bootdev_writeable_status (const char *bootdev, bool make_writeable)
+set_bootdev_writeable_status (int fd, bool make_writeable)
 {
-	char pathname[64];
 	char buf[1];
-	int fd, is_writeable, rc = 0;
+	int is_writeable, rc = 0;
 
-	if (bootdev == NULL)
-		return false;
-	if (strlen(bootdev) < 6 || strlen(bootdev) > 32)
-		return false;
-	sprintf(pathname, "/sys/block/%s/force_ro", bootdev + 5);
-	fd = open(pathname, O_RDWR);
 	if (fd < 0)
 		return false;
-	if (read(fd, buf, sizeof(buf)) != sizeof(buf)) {
-		close(fd);
+	if (pread(fd, buf, sizeof(buf), 0) != sizeof(buf))
 		return false;
-	}
 	make_writeable = !!make_writeable;
 	is_writeable = buf[0] == '0';
 	if (make_writeable && !is_writeable) {
-		if (write(fd, "0", 1) != 1)
+		if (pwrite(fd, "0", 1, 0) != 1)
 			rc = 1;
 	} else if (!make_writeable && is_writeable) {
-		if (write(fd, "1", 1) != 1)
+		if (pwrite(fd, "1", 1, 0) != 1)
 			rc = 1;
 	}
-	close(fd);
 
 	if (rc)
 		fprintf(stderr, "warning: could not change boot device write status\n");
@@ -3,7 +3,8 @@
 /* Copyright (c) 2021, Matthew Madison */
 
 #include <stdbool.h>
-bool set_bootdev_writeable_status(const char *bootdev, bool make_writeble);
+int bootdev_force_ro_open(const char *bootdev);
+bool set_bootdev_writeable_status(int fd, bool make_writeble);
 bool partition_should_be_present(const char *partname);
 
 #endif /* util_h_included */